@@ -0,0 +1,473 @@
+// Micro benchmarks for "mywarrior bench", part of the single translation
+// unit of main.cc, which includes it after everything they measure.
+#pragma once
+
+template <typename Fn>
+double time_seconds(Fn &&fn) {
+  auto start{std::chrono::steady_clock::now()};
+  fn();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Random sessions of 1 to 120 minutes, spread over roughly ten years
+std::vector<Session> random_sessions(std::size_t count, std::uint64_t seed) {
+  std::mt19937_64 rng{seed};
+  std::uniform_int_distribution<std::int64_t> start_dist{0, 10*365*86400LL},
+    length_dist{60, 120*60};
+  std::vector<Session> sessions(count);
+  for (auto &session : sessions) {
+    session.start = start_dist(rng);
+    session.end = session.start + length_dist(rng);
+  }
+  return sessions;
+}
+
+// Same accumulators, once through ReportEngine's virtual calls and once
+// fused at compile time, over sessions already in memory
+void bench_aggregators(std::size_t count) {
+  auto sessions{random_sessions(count, 42)};
+  auto dict{Dictionary{}};
+  std::ostringstream sink;
+
+  ReportEngine engine{INT64_MIN, INT64_MAX};
+  engine.add(std::make_unique<SessionStatsAccumulator>());
+  engine.add(std::make_unique<LongestSessionAccumulator>());
+  engine.add(std::make_unique<SpanAccumulator>());
+  double runtime{time_seconds([&] {
+    for (const auto &session : sessions) {
+      engine.update(session);
+    }
+  })};
+  engine.print(sink, dict);
+
+  FusedAggregator<SessionStatsAccumulator, LongestSessionAccumulator,
+    SpanAccumulator> fused{INT64_MIN, INT64_MAX};
+  double compiletime{time_seconds([&] {
+    for (const auto &session : sessions) {
+      fused.update(session);
+    }
+  })};
+  std::string runtime_out{sink.str()};
+  sink.str("");
+  fused.print(sink, dict);
+
+  std::cout << "virtual accumulators: " << runtime/count*1e9 << " ns/session" << std::endl;
+  std::cout << "fused accumulators: " << compiletime/count*1e9 << " ns/session"
+    << (runtime_out == sink.str() ? "" : " (MISMATCH)") << std::endl;
+}
+
+// The session table kernels against plain loops over the same columns
+void bench_session_table(std::size_t count) {
+  SessionTable table;
+  for (const auto &session : random_sessions(count, 42)) {
+    table.push_back(session);
+  }
+  const std::int32_t *durations{table.duration.data()};
+  std::int64_t simd_sum{0}, plain_sum{0};
+  double simd{time_seconds([&] { simd_sum = sum_int32(durations, count); })};
+  double plain{time_seconds([&] {
+    for (std::size_t i{0}; i < count; ++i) {
+      plain_sum += durations[i];
+    }
+  })};
+  std::cout << "sum: " << simd*1e3 << " ms vs " << plain*1e3 << " ms"
+    << (simd_sum == plain_sum ? "" : " (MISMATCH)") << std::endl;
+
+  std::int32_t min, max;
+  simd = time_seconds([&] { minmax_int32(durations, count, min, max); });
+  std::cout << "min/max: " << simd*1e3 << " ms" << std::endl;
+
+  std::vector<std::uint32_t> selected, expected;
+  std::int64_t lo{365*86400LL}, hi{5*365*86400LL};
+  simd = time_seconds([&] { filter_range(table.start.data(), count, lo, hi, selected); });
+  plain = time_seconds([&] {
+    for (std::size_t i{0}; i < count; ++i) {
+      if (table.start[i] >= lo && table.start[i] < hi) {
+        expected.push_back(static_cast<std::uint32_t>(i));
+      }
+    }
+  });
+  std::cout << "range filter: " << simd*1e3 << " ms vs " << plain*1e3 << " ms"
+    << (selected == expected ? "" : " (MISMATCH)") << std::endl;
+
+  std::vector<std::uint64_t> counts(32), plain_counts(32);
+  simd = time_seconds([&] { histogram_int32(durations, count, 300, counts.data(), 32); });
+  plain = time_seconds([&] {
+    for (std::size_t i{0}; i < count; ++i) {
+      plain_counts[std::min<std::size_t>(static_cast<std::size_t>(durations[i]/300), 31)]++;
+    }
+  });
+  // values right at and below the bucket edges, over the whole int32 range
+  constexpr std::int32_t EDGE_WIDTH{(1 << 20) + 3};
+  constexpr std::size_t EDGE_BUCKETS{4096};
+  std::vector<std::int32_t> edges;
+  for (std::int64_t k{1}; k*EDGE_WIDTH <= INT32_MAX; ++k) {
+    edges.push_back(static_cast<std::int32_t>(k*EDGE_WIDTH - 1));
+    edges.push_back(static_cast<std::int32_t>(k*EDGE_WIDTH));
+  }
+  edges.push_back(INT32_MAX);
+  std::vector<std::uint64_t> edge_counts(EDGE_BUCKETS), plain_edge_counts(EDGE_BUCKETS);
+  histogram_int32(edges.data(), edges.size(), EDGE_WIDTH, edge_counts.data(), EDGE_BUCKETS);
+  for (auto v : edges) {
+    plain_edge_counts[std::min<std::size_t>(static_cast<std::size_t>(v/EDGE_WIDTH),
+        EDGE_BUCKETS-1)]++;
+  }
+  std::cout << "histogram: " << simd*1e3 << " ms vs " << plain*1e3 << " ms"
+    << (counts == plain_counts && edge_counts == plain_edge_counts ? "" : " (MISMATCH)")
+    << std::endl;
+}
+
+// Decoding records with a large "notes" key in full against decoding only
+// what a report on start, end and phase needs
+void bench_projection(std::size_t count) {
+  std::string notes;
+  for (std::size_t i{0}; notes.size() < 2048; ++i) {
+    notes += i % 16 ? "lorem ipsum, " : "a \\\"quoted\\\" {brace} ";
+  }
+  std::string lines;
+  char iso[19];
+  for (const auto &session : random_sessions(count, 42)) {
+    lines += "{\"start\":\"";
+    format_iso(session.start, iso);
+    lines.append(iso, sizeof(iso));
+    lines += "\",\"end\":\"";
+    format_iso(session.end, iso);
+    lines.append(iso, sizeof(iso));
+    lines += "\",\"phase\":\"work\",\"project\":1,\"notes\":\"" + notes + "\"}\n";
+  }
+  // split up front, only the decoding is timed
+  std::vector<std::string_view> records;
+  for (std::size_t begin{0}; begin < lines.size(); ) {
+    auto end{lines.find('\n', begin)};
+    records.push_back(std::string_view{lines}.substr(begin, end-begin));
+    begin = end+1;
+  }
+  auto decode_all = [&records](unsigned fields, std::int64_t &checksum) {
+    Session session;
+    for (auto record : records) {
+      if (!decode_session(record, session, fields)) {
+        throw std::runtime_error("Malformed benchmark record");
+      }
+      checksum += session.end - session.start + static_cast<std::int64_t>(session.phase);
+    }
+  };
+  std::int64_t full_sum{0}, projected_sum{0};
+  double full{time_seconds([&] { decode_all(FIELD_ALL, full_sum); })};
+  double projected{time_seconds([&] { decode_all(FIELD_PHASE, projected_sum); })};
+  double mb{static_cast<double>(lines.size()) / (1 << 20)};
+  std::cout << "full decode: " << full*1e3 << " ms (" << mb/full << " MiB/s)" << std::endl;
+  std::cout << "start, end and phase only: " << projected*1e3 << " ms (" << mb/projected
+    << " MiB/s)" << (full_sum == projected_sum ? "" : " (MISMATCH)") << std::endl;
+}
+
+// CRC32C per implementation against a plain copy of the same bytes, and
+// checking every record of a log written with checksums
+void bench_crc(std::size_t count) {
+  if (crc32c_scalar(0, "123456789", 9) != 0xE3069283u || crc32c("123456789") != 0xE3069283u) {
+    throw std::runtime_error("CRC32C self test failed");
+  }
+  std::string lines;
+  bool previous{write_checksums};
+  write_checksums = true;
+  for (const auto &session : random_sessions(count, 42)) {
+    encode_session(session, lines);
+  }
+  write_checksums = previous;
+  double mb{static_cast<double>(lines.size()) / (1 << 20)};
+  auto report = [mb](const char *name, double seconds) {
+    std::cout << name << ": " << seconds*1e3 << " ms (" << mb/seconds << " MiB/s)" << std::endl;
+  };
+  std::vector<char> copy(lines.size());
+  report("memcpy", time_seconds([&] { std::memcpy(copy.data(), lines.data(), lines.size()); }));
+  std::uint32_t scalar{0}, fast{0};
+  report("slicing-by-8", time_seconds([&] {
+    scalar = crc32c_scalar(0, lines.data(), lines.size());
+  }));
+#ifdef __x86_64__
+  if (cpu_has_sse42()) {
+    report("sse4.2", time_seconds([&] { fast = crc32c_sse42(0, lines.data(), lines.size()); }));
+    if (fast != scalar) {
+      std::cout << "MISMATCH" << std::endl;
+    }
+  }
+#endif
+  std::size_t corrupt{0};
+  report("per record check", time_seconds([&] {
+    std::string_view rest{lines};
+    while (!rest.empty()) {
+      auto nl{rest.find('\n')};
+      corrupt += check_record_crc(rest.substr(0, nl)) != RecordCheck::ok;
+      rest.remove_prefix(nl + 1);
+    }
+  }));
+  if (corrupt) {
+    std::cout << corrupt << " records failed their check (MISMATCH)" << std::endl;
+  }
+}
+
+// Writing and reading a track file with plain system calls against io_uring,
+// the reads come from a warm page cache
+void bench_io(std::size_t count) {
+  std::string lines;
+  for (const auto &session : random_sessions(count, 42)) {
+    encode_session(session, lines);
+  }
+  const std::string path{TRACK_FILE + ".bench"};
+  double mb{static_cast<double>(lines.size()) / (1 << 20)};
+  bool previous{use_io_uring};
+  if (!UringWriteBehind::open(STDOUT_FILENO, 4096)) {
+    std::cout << "io_uring unavailable, both runs use pread and write" << std::endl;
+  }
+  for (bool uring : {false, true}) {
+    use_io_uring = uring;
+    double write{time_seconds([&] {
+      OutputBuffer out{path, 1 << 20};
+      for (std::size_t i{0}; i < lines.size(); i += 4096) {
+        out.append(std::string_view{lines}.substr(i, 4096));
+      }
+      out.flush();
+    })};
+    std::uint64_t bytes{0};
+    double read{time_seconds([&] {
+      LineReader reader{path};
+      std::string_view block;
+      while (reader.next_lines(block)) {
+        bytes += block.size();
+      }
+    })};
+    const char *name{uring ? "io_uring" : "pread/write"};
+    std::cout << name << " write: " << write*1e3 << " ms (" << mb/write << " MiB/s)" << std::endl;
+    std::cout << name << " read: " << read*1e3 << " ms (" << mb/read << " MiB/s)"
+      << (bytes == lines.size() ? "" : " (MISMATCH)") << std::endl;
+  }
+  use_io_uring = previous;
+  ::unlink(path.c_str());
+}
+
+// Exports a generated log as csv and imports it into an empty one, which
+// has to export to the same file again
+void bench_csv(std::size_t count) {
+  namespace fs = std::filesystem;
+  auto previous{fs::current_path()};
+  auto root{fs::temp_directory_path() / ("mywarrior-bench-" + std::to_string(::getpid()))};
+  fs::create_directories(root / "from");
+  fs::create_directories(root / "to");
+  fs::current_path(root / "from");
+  {
+    // labels that need quoting, between sessions that do not overlap
+    auto dict{Dictionary::load()};
+    const std::uint32_t labels[]{0, dict.intern("plain"), dict.intern("a, b"),
+      dict.intern("say \"hi\"")};
+    std::mt19937_64 rng{42};
+    std::vector<Session> sessions(count);
+    std::int64_t start{0};
+    for (auto &session : sessions) {
+      session.start = start + static_cast<std::int64_t>(rng() % 3600);
+      session.end = session.start + 60 + static_cast<std::int64_t>(rng() % 7200);
+      session.phase = static_cast<Phase>(rng() % PHASE_COUNT);
+      session.project = labels[rng() % 4];
+      session.tag = labels[rng() % 4];
+      start = session.end;
+    }
+    append_sessions(sessions);
+  }
+  double exported{time_seconds([] {
+    export_main(ExportFormat::csv, "../a.csv", INT64_MIN, INT64_MAX);
+  })};
+  fs::current_path(root / "to");
+  double imported{time_seconds([] { import_main(ImportFormat::csv, "../a.csv"); })};
+  export_main(ExportFormat::csv, "../b.csv", INT64_MIN, INT64_MAX);
+  fs::current_path(previous);
+  bool same{read_all(root / "a.csv") == read_all(root / "b.csv")};
+  fs::remove_all(root);
+  std::cout << "csv export: " << exported*1e3 << " ms, import: " << imported*1e3 << " ms"
+    << (same ? "" : " (MISMATCH)") << std::endl;
+}
+
+// Imports every other session of a log, newest first, into one holding the
+// rest, which has to export like the whole log before and after compact
+void bench_late(std::size_t count) {
+  namespace fs = std::filesystem;
+  auto previous{fs::current_path()};
+  auto root{fs::temp_directory_path() / ("mywarrior-bench-" + std::to_string(::getpid()))};
+  std::mt19937_64 rng{42};
+  std::vector<Session> sessions(count), odd, even;
+  std::int64_t start{0};
+  for (std::size_t i{0}; i < count; ++i) {
+    auto &session{sessions[i]};
+    session.start = start + static_cast<std::int64_t>(rng() % 3600);
+    session.end = session.start + 60 + static_cast<std::int64_t>(rng() % 7200);
+    session.phase = static_cast<Phase>(rng() % PHASE_COUNT);
+    start = session.end;
+    (i % 2 ? odd : even).push_back(session);
+  }
+  for (const auto &[dir, part] : {std::pair{"all", &sessions}, {"to", &odd}, {"old", &even}}) {
+    fs::create_directories(root / dir);
+    fs::current_path(root / dir);
+    append_sessions(*part);
+  }
+  export_main(ExportFormat::csv, "../old.csv", INT64_MIN, INT64_MAX);
+  {
+    // newest first, so every batch of the import is a run of its own
+    std::string csv{read_all(root / "old.csv")};
+    std::size_t header{csv.find('\n') + 1}, end{csv.size()};
+    std::string reversed{csv.substr(0, header)};
+    while (end > header) {
+      std::size_t begin{csv.rfind('\n', end - 2) + 1};
+      reversed.append(csv, begin, end - begin);
+      end = begin;
+    }
+    replace_file(root / "old.csv", reversed);
+  }
+  fs::current_path(root / "all");
+  export_main(ExportFormat::ndjson, "../all.ndjson", INT64_MIN, INT64_MAX);
+  fs::current_path(root / "to");
+  double imported{time_seconds([] { import_main(ImportFormat::csv, "../old.csv"); })};
+  std::size_t runs{late_ranges().size()};
+  double exported{time_seconds([] {
+    export_main(ExportFormat::ndjson, "../merged.ndjson", INT64_MIN, INT64_MAX);
+  })};
+  double compacted{time_seconds([] { compact_main(); })};
+  export_main(ExportFormat::ndjson, "../compacted.ndjson", INT64_MIN, INT64_MAX);
+  fs::current_path(previous);
+  std::string expected{read_all(root / "all.ndjson")};
+  bool same{read_all(root / "merged.ndjson") == expected
+    && read_all(root / "compacted.ndjson") == expected};
+  fs::remove_all(root);
+  std::cout << "late import: " << imported*1e3 << " ms in " << runs << " runs, export: "
+    << exported*1e3 << " ms, compact: " << compacted*1e3 << " ms"
+    << (same ? "" : " (MISMATCH)") << std::endl;
+}
+
+// Throughput of the structural scan per instruction set, and decoding
+// through the index against decoding with the cursor alone
+void bench_structural(std::size_t count) {
+  std::string lines;
+  std::uint32_t label{0};
+  for (auto session : random_sessions(count, 42)) {
+    session.project = label++ % 4;
+    encode_session(session, lines);
+  }
+  double gb{static_cast<double>(lines.size()) / 1e9};
+  StructuralIndex index, expected;
+  structural_index_scalar(lines.data(), lines.size(), expected);
+  using Kernel = void (*)(const char *, std::size_t, StructuralIndex &);
+  std::vector<std::pair<const char *, Kernel>> kernels{{"scalar", structural_index_scalar}};
+#ifdef MYWARRIOR_X86
+  kernels.emplace_back("sse2", structural_index_sse2);
+  if (cpu_has_avx2()) {
+    kernels.emplace_back("avx2", structural_index_avx2);
+  }
+#endif
+  for (const auto &[name, kernel] : kernels) {
+    index.clear();
+    index.claim(lines.size());
+    double secs{time_seconds([&] { kernel(lines.data(), lines.size(), index); })};
+    std::cout << "structural scan (" << name << "): " << gb/secs << " GB/s"
+      << (index == expected ? "" : " (MISMATCH)") << std::endl;
+  }
+
+  std::int64_t cursor_sum{0}, indexed_sum{0};
+  double cursor{time_seconds([&] {
+    Session session;
+    std::size_t begin{0};
+    while (begin < lines.size()) {
+      auto end{lines.find('\n', begin)};
+      decode_session(std::string_view{lines}.substr(begin, end - begin), session);
+      cursor_sum += session.end - session.start + session.project;
+      begin = end + 1;
+    }
+  })};
+  // a block of lines at a time, as for_each_indexed_line gets them
+  double indexed{time_seconds([&] {
+    Session session;
+    for (std::size_t block{0}; block < lines.size(); ) {
+      std::size_t block_end{lines.rfind('\n', std::min(lines.size(), block + (1 << 20)) - 1) + 1};
+      index.clear();
+      structural_index(lines.data() + block, block_end - block, index);
+      std::size_t begin{0}, first{0};
+      for (std::size_t i{0}; i < index.size(); ++i) {
+        if (lines[block + index[i]] != '\n') {
+          continue;
+        }
+        for (std::size_t j{first}; j < i; ++j) {
+          index[j] -= static_cast<std::uint32_t>(begin);
+        }
+        decode_session_indexed(std::string_view{lines}.substr(block + begin, index[i] - begin),
+            index.data() + first, i - first, session);
+        indexed_sum += session.end - session.start + session.project;
+        begin = index[i] + 1;
+        first = i + 1;
+      }
+      block = block_end;
+    }
+  })};
+  std::cout << "line split and decode with cursor: " << gb/cursor << " GB/s" << std::endl;
+  std::cout << "line split and decode with index: " << gb/indexed << " GB/s"
+    << (cursor_sum == indexed_sum ? "" : " (MISMATCH)") << std::endl;
+}
+
+void bench_interval_tree(std::size_t count) {
+  auto sessions{random_sessions(count, 42)};
+  IntervalTree tree;
+  double build{time_seconds([&] { tree = IntervalTree{sessions}; })};
+  std::cout << "build " << count << " intervals: " << build*1e3 << " ms" << std::endl;
+
+  constexpr std::size_t QUERIES{100000}, LINEAR_QUERIES{200};
+  auto queries{random_sessions(QUERIES, 7)};
+  std::uint64_t hits{0}, checked_hits{0};
+  double tree_time{time_seconds([&] {
+    for (std::size_t i{0}; i < QUERIES; ++i) {
+      if (i == LINEAR_QUERIES) {
+        checked_hits = hits;
+      }
+      tree.overlapping(queries[i].start, queries[i].end,
+          [&hits](const IntervalTree::Node &) { hits++; });
+    }
+  })};
+  std::uint64_t linear_hits{0};
+  double linear_time{time_seconds([&] {
+    for (std::size_t i{0}; i < LINEAR_QUERIES; ++i) {
+      for (const auto &session : sessions) {
+        linear_hits += session.start < queries[i].end && queries[i].start < session.end;
+      }
+    }
+  })};
+  std::cout << "tree query: " << tree_time/QUERIES*1e9 << " ns ("
+    << static_cast<double>(hits)/QUERIES << " hits avg)" << std::endl;
+  std::cout << "linear scan query: " << linear_time/LINEAR_QUERIES*1e9 << " ns"
+    << (linear_hits == checked_hits ? "" : " (MISMATCH)") << std::endl;
+  std::int64_t total{0};
+  double union_time{time_seconds([&] { total = tree.union_seconds(); })};
+  std::cout << "union total: " << union_time*1e3 << " ms ("
+    << format_seconds(total) << ")" << std::endl;
+
+  // every query against a linear scan, at sizes around the powers of two
+  // where the implicit tree is incomplete
+  std::mt19937_64 rng{1};
+  std::uint64_t checked{0}, mismatches{0};
+  for (std::size_t n{1}; n <= 1100; n += n < 300 ? 1 : 37) {
+    std::uniform_int_distribution<std::int64_t> start_dist{0, static_cast<std::int64_t>(n)*25},
+      length_dist{1, 60};
+    std::vector<Session> small(n);
+    for (auto &session : small) {
+      session.start = start_dist(rng);
+      session.end = session.start + length_dist(rng);
+    }
+    IntervalTree small_tree{small};
+    for (int q{0}; q < 200; ++q) {
+      std::int64_t start{start_dist(rng)}, end{start + length_dist(rng)};
+      std::uint64_t tree_count{0}, linear_count{0};
+      small_tree.overlapping(start, end, [&tree_count](const IntervalTree::Node &) {
+        tree_count++;
+      });
+      for (const auto &session : small) {
+        linear_count += session.start < end && start < session.end;
+      }
+      checked++;
+      mismatches += tree_count != linear_count;
+    }
+  }
+  std::cout << "checked " << checked << " queries against a linear scan: "
+    << (mismatches ? std::to_string(mismatches) + " MISMATCHES" : "all match") << std::endl;
+}
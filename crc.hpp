@@ -0,0 +1,84 @@
+// CRC32C (Castagnoli), part of the single translation unit of main.cc.
+// Uses the SSE 4.2 instruction where there is one.
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "simd.hpp"
+
+bool cpu_has_sse42() {
+#ifdef MYWARRIOR_X86
+  static const bool has_sse42{__builtin_cpu_supports("sse4.2") != 0};
+  return has_sse42;
+#else
+  return false;
+#endif
+}
+
+// Slicing-by-8: table j holds the CRC of a byte followed by j zero bytes
+const std::array<std::array<std::uint32_t, 256>, 8> &crc32c_tables() {
+  static const auto tables{[] {
+    std::array<std::array<std::uint32_t, 256>, 8> t{};
+    for (std::uint32_t i{0}; i < 256; ++i) {
+      std::uint32_t crc{i};
+      for (int k{0}; k < 8; ++k) {
+        crc = crc >> 1 ^ (crc & 1 ? 0x82F63B78u : 0);
+      }
+      t[0][i] = crc;
+    }
+    for (std::size_t j{1}; j < 8; ++j) {
+      for (std::size_t i{0}; i < 256; ++i) {
+        t[j][i] = t[j-1][i] >> 8 ^ t[0][t[j-1][i] & 0xff];
+      }
+    }
+    return t;
+  }()};
+  return tables;
+}
+
+// Words are loaded little endian, like on every machine we build for
+std::uint32_t crc32c_scalar(std::uint32_t crc, const char *data, std::size_t len) {
+  const auto &t{crc32c_tables()};
+  crc = ~crc;
+  for (; len >= 8; data += 8, len -= 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    word ^= crc;
+    crc = t[7][word & 0xff] ^ t[6][word >> 8 & 0xff] ^ t[5][word >> 16 & 0xff]
+      ^ t[4][word >> 24 & 0xff] ^ t[3][word >> 32 & 0xff] ^ t[2][word >> 40 & 0xff]
+      ^ t[1][word >> 48 & 0xff] ^ t[0][word >> 56];
+  }
+  for (; len; ++data, --len) {
+    crc = crc >> 8 ^ t[0][(crc ^ static_cast<unsigned char>(*data)) & 0xff];
+  }
+  return ~crc;
+}
+
+#ifdef __x86_64__
+__attribute__((target("sse4.2")))
+std::uint32_t crc32c_sse42(std::uint32_t crc, const char *data, std::size_t len) {
+  std::uint64_t wide{~crc};
+  for (; len >= 8; data += 8, len -= 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    wide = _mm_crc32_u64(wide, word);
+  }
+  auto narrow{static_cast<std::uint32_t>(wide)};
+  for (; len; ++data, --len) {
+    narrow = _mm_crc32_u8(narrow, static_cast<unsigned char>(*data));
+  }
+  return ~narrow;
+}
+#endif
+
+std::uint32_t crc32c(std::string_view data, std::uint32_t crc = 0) {
+#ifdef __x86_64__
+  if (cpu_has_sse42()) {
+    return crc32c_sse42(crc, data.data(), data.size());
+  }
+#endif
+  return crc32c_scalar(crc, data.data(), data.size());
+}
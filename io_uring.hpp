@@ -0,0 +1,384 @@
+// Read-ahead and write-behind through io_uring, part of the single
+// translation unit of main.cc after debug_print. open() returns nullptr
+// where io_uring is unavailable.
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define MYWARRIOR_URING 1
+#endif
+
+#ifdef MYWARRIOR_URING
+// The few io_uring calls we need, on the raw system calls. A ring belongs
+// to one thread.
+class IoUring {
+ public:
+  explicit IoUring(unsigned entries) {
+    io_uring_params params{};
+    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      throw std::runtime_error(std::string{"io_uring_setup failed: "} + std::strerror(errno));
+    }
+    try {
+      map_rings(params);
+    } catch (...) {
+      release();
+      throw;
+    }
+  }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  ~IoUring() { release(); }
+
+  bool has_feature(unsigned feature) const { return (features_ & feature) != 0; }
+
+  // Pins the buffers once, so fixed reads and writes skip the mapping
+  void register_buffers(const std::vector<iovec> &buffers) {
+    if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, buffers.data(),
+          buffers.size()) < 0) {
+      throw std::runtime_error(std::string{"Could not register buffers: "} + std::strerror(errno));
+    }
+  }
+
+  // The caller keeps at most `entries` requests in flight
+  void queue(std::uint8_t opcode, int fd, void *buf, unsigned len, std::uint64_t offset,
+      unsigned buf_index, std::uint64_t user_data) {
+    unsigned tail{*sq_tail_};
+    unsigned index{tail & sq_mask_};
+    io_uring_sqe &sqe{sqes_[index]};
+    sqe = io_uring_sqe{};
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<std::uint64_t>(buf);
+    sqe.len = len;
+    sqe.off = offset;
+    sqe.buf_index = static_cast<std::uint16_t>(buf_index);
+    sqe.user_data = user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++queued_;
+  }
+
+  // Hands the queued requests to the kernel without waiting
+  void submit() { enter(0); }
+
+  // Next completion, submits what is queued and blocks if there is none
+  io_uring_cqe wait() {
+    while (true) {
+      unsigned head{*cq_head_};
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        io_uring_cqe cqe{cqes_[head & cq_mask_]};
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return cqe;
+      }
+      enter(1);
+    }
+  }
+
+ private:
+  void enter(unsigned min_complete) {
+    if (!queued_ && !min_complete) {
+      return;
+    }
+    while (true) {
+      long n{::syscall(__NR_io_uring_enter, fd_, queued_, min_complete,
+          min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0)};
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        throw std::runtime_error(std::string{"io_uring_enter failed: "} + std::strerror(errno));
+      }
+      queued_ -= static_cast<unsigned>(n);
+      return;
+    }
+  }
+
+  void map_rings(const io_uring_params &params) {
+    features_ = params.features;
+    sq_ring_size_ = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+    bool single{has_feature(IORING_FEAT_SINGLE_MMAP)};
+    if (single) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries*sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(map(sqes_size_, IORING_OFF_SQES));
+
+    char *sq{static_cast<char *>(sq_ring_)}, *cq{static_cast<char *>(cq_ring_)};
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  void *map(std::size_t size, std::uint64_t offset) {
+    void *ptr{::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+        static_cast<off_t>(offset))};
+    if (ptr == MAP_FAILED) {
+      throw std::runtime_error(std::string{"Could not map io_uring: "} + std::strerror(errno));
+    }
+    return ptr;
+  }
+
+  void release() {
+    if (sqes_) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    ::close(fd_);
+  }
+
+  int fd_{-1};
+  unsigned features_{0}, queued_{0};
+  void *sq_ring_{nullptr}, *cq_ring_{nullptr};
+  io_uring_sqe *sqes_{nullptr};
+  std::size_t sq_ring_size_{0}, cq_ring_size_{0}, sqes_size_{0};
+  unsigned *sq_tail_{nullptr}, *sq_array_{nullptr}, *cq_head_{nullptr}, *cq_tail_{nullptr};
+  unsigned sq_mask_{0}, cq_mask_{0};
+  io_uring_cqe *cqes_{nullptr};
+};
+
+// Reads a regular file front to back and keeps the next blocks in flight in
+// registered buffers while the caller parses the current one
+class UringReadAhead {
+ public:
+  static constexpr unsigned DEPTH{4};
+
+  // nullptr if the kernel does not let us, the caller then uses pread
+  static std::unique_ptr<UringReadAhead> open(int fd, std::uint64_t begin, std::uint64_t end,
+      std::size_t block) {
+    try {
+      return std::make_unique<UringReadAhead>(fd, begin, end, block);
+    } catch (const std::exception &err) {
+      debug_print("io_uring reads unavailable: ", err.what());
+      return nullptr;
+    }
+  }
+
+  UringReadAhead(int fd, std::uint64_t begin, std::uint64_t end, std::size_t block)
+    : ring_{DEPTH}, buf_(DEPTH*block), block_{block}, fd_{fd}, next_{begin}, expected_{begin},
+      end_{end} {
+    std::vector<iovec> buffers(DEPTH);
+    for (unsigned i{0}; i < DEPTH; ++i) {
+      buffers[i] = iovec{buf_.data() + i*block, block};
+    }
+    ring_.register_buffers(buffers);
+    for (unsigned i{0}; i < DEPTH; ++i) {
+      queue(i);
+    }
+    ring_.submit();
+  }
+
+  UringReadAhead(const UringReadAhead &) = delete;
+  UringReadAhead &operator=(const UringReadAhead &) = delete;
+
+  // the kernel may still write into the buffers
+  ~UringReadAhead() {
+    try {
+      while (std::any_of(slots_.begin(), slots_.end(), [](const Slot &s) { return s.busy; })) {
+        slots_[ring_.wait().user_data].busy = false;
+      }
+    } catch (const std::exception &) {
+    }
+  }
+
+  // Like read(2): at most len bytes, 0 only at the end
+  std::size_t read(char *dst, std::size_t len) {
+    while (true) {
+      Slot &slot{slots_[current_]};
+      while (slot.busy) {
+        complete(ring_.wait());
+      }
+      if (slot.offset != expected_) {
+        // a short read before it, this block starts at the wrong place
+        next_ = expected_;
+        queue(current_);
+        ring_.submit();
+        continue;
+      }
+      if (slot.pos == slot.size) {
+        return 0;
+      }
+      std::size_t n{std::min(len, slot.size - slot.pos)};
+      std::memcpy(dst, buf_.data() + current_*block_ + slot.pos, n);
+      slot.pos += n;
+      expected_ += n;
+      if (slot.pos == slot.size) {
+        queue(current_);
+        ring_.submit();
+        current_ = (current_ + 1) % DEPTH;
+      }
+      return n;
+    }
+  }
+
+ private:
+  struct Slot {
+    std::uint64_t offset{0};
+    std::size_t size{0}, pos{0};
+    bool busy{false};
+  };
+
+  void queue(unsigned i) {
+    Slot &slot{slots_[i]};
+    slot = Slot{next_, 0, 0, false};
+    if (next_ >= end_) {
+      return;
+    }
+    auto len{static_cast<unsigned>(std::min<std::uint64_t>(block_, end_ - next_))};
+    ring_.queue(IORING_OP_READ_FIXED, fd_, buf_.data() + i*block_, len, next_, i, i);
+    slot.busy = true;
+    next_ += len;
+  }
+
+  void complete(const io_uring_cqe &cqe) {
+    Slot &slot{slots_[cqe.user_data]};
+    slot.busy = false;
+    if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+      std::uint64_t next{next_};
+      next_ = slot.offset;
+      queue(static_cast<unsigned>(cqe.user_data));
+      next_ = next;
+      ring_.submit();
+    } else if (cqe.res < 0) {
+      throw std::runtime_error(std::string{"Read failed: "} + std::strerror(-cqe.res));
+    } else {
+      slot.size = static_cast<std::size_t>(cqe.res);
+    }
+  }
+
+  IoUring ring_;
+  std::vector<char> buf_;
+  std::array<Slot, DEPTH> slots_;
+  std::size_t block_;
+  int fd_;
+  unsigned current_{0};
+  // where the next request reads, and where the caller is
+  std::uint64_t next_, expected_, end_;
+};
+
+// Writes from two registered buffers, one filling while the other is in
+// flight, so appends and pipes keep their order.
+class UringWriteBehind {
+ public:
+  // nullptr if the kernel does not let us, the caller then uses write
+  static std::unique_ptr<UringWriteBehind> open(int fd, std::size_t block) {
+    try {
+      return std::make_unique<UringWriteBehind>(fd, block);
+    } catch (const std::exception &err) {
+      debug_print("io_uring writes unavailable: ", err.what());
+      return nullptr;
+    }
+  }
+
+  UringWriteBehind(int fd, std::size_t block) : ring_{2}, buf_(2*block), block_{block}, fd_{fd} {
+    // offset -1 has to mean the file position
+    if (!ring_.has_feature(IORING_FEAT_RW_CUR_POS)) {
+      throw std::runtime_error("io_uring without IORING_FEAT_RW_CUR_POS");
+    }
+    ring_.register_buffers({iovec{buf_.data(), block}, iovec{buf_.data() + block, block}});
+  }
+
+  UringWriteBehind(const UringWriteBehind &) = delete;
+  UringWriteBehind &operator=(const UringWriteBehind &) = delete;
+
+  ~UringWriteBehind() {
+    try {
+      wait();
+    } catch (const std::exception &) {
+    }
+  }
+
+  std::size_t block_size() const { return block_; }
+
+  // The buffer to fill next
+  char *block() { return buf_.data() + current_*block_; }
+
+  // Sends the first len bytes of block() and switches to the other buffer
+  void write(std::size_t len) {
+    wait();
+    if (len) {
+      in_flight_ = current_;
+      done_ = 0;
+      len_ = len;
+      queue();
+    }
+    current_ ^= 1;
+  }
+
+  // Until everything sent reached the file
+  void wait() {
+    while (in_flight_ >= 0) {
+      io_uring_cqe cqe{ring_.wait()};
+      if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN) {
+        in_flight_ = -1;
+        throw std::runtime_error(std::string{"Write failed: "} + std::strerror(-cqe.res));
+      }
+      done_ += static_cast<std::size_t>(std::max(0, cqe.res));
+      if (done_ == len_) {
+        in_flight_ = -1;
+      } else {
+        queue();
+      }
+    }
+  }
+
+ private:
+  void queue() {
+    char *data{buf_.data() + static_cast<unsigned>(in_flight_)*block_};
+    ring_.queue(IORING_OP_WRITE_FIXED, fd_, data + done_, static_cast<unsigned>(len_ - done_),
+        static_cast<std::uint64_t>(-1), static_cast<unsigned>(in_flight_), 0);
+    ring_.submit();
+  }
+
+  IoUring ring_;
+  std::vector<char> buf_;
+  std::size_t block_, done_{0}, len_{0};
+  int fd_;
+  unsigned current_{0};
+  int in_flight_{-1};
+};
+#else
+// Without the io_uring headers the backends never open
+struct UringReadAhead {
+  static std::unique_ptr<UringReadAhead> open(int, std::uint64_t, std::uint64_t, std::size_t) {
+    return nullptr;
+  }
+  std::size_t read(char *, std::size_t) { return 0; }
+};
+
+struct UringWriteBehind {
+  static std::unique_ptr<UringWriteBehind> open(int, std::size_t) { return nullptr; }
+  std::size_t block_size() const { return 0; }
+  char *block() { return nullptr; }
+  void write(std::size_t) {}
+  void wait() {}
+};
+#endif
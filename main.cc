@@ -1,13 +1,41 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cctype>
 #include <chrono>
+#include <cmath>
 #include <csignal>
+#include <exception>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
 
 namespace nc {
   #include <ncurses.h>
@@ -15,10 +43,17 @@ namespace nc {
 
 #include "argparse.hpp"
 #include "json.hpp"
+#include "simd.hpp"
+#include "crc.hpp"
 
 bool sigint_recieved{false};
+// --io-uring, readers and writers fall back to pread/write on their own
+bool use_io_uring{false};
+// --checksums, records written get a CRC32C
+bool write_checksums{false};
 
 const std::string TRACK_FILE{"mywarrior.ndjson"};
+const std::string DICT_FILE{"mywarrior.dict"};
 
 template <typename ...Args>
 void debug_print(Args &&...args) {
@@ -44,7 +79,7 @@ std::string format_seconds(Num total_seconds) {
   if (hours) {
     oss << std::setw(2) << std::setfill('0') << hours << ":";
   }
-  if (mins) {
+  if (hours || mins) {
     oss << std::setw(2) << std::setfill('0') << mins << ":";
   }
   oss << std::setw(2) << std::setfill('0') << secs;
@@ -59,6 +94,461 @@ std::string timepoint_to_iso(const typename Clock::time_point &tp) {
   return oss.str();
 }
 
+// "Civil seconds": local wall clock time counted as if it was UTC, see
+// http://howardhinnant.github.io/date_algorithms.html
+std::int64_t days_from_civil(std::int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const std::int64_t era{(y >= 0 ? y : y-399) / 400};
+  const unsigned yoe{static_cast<unsigned>(y - era * 400)};
+  const unsigned doy{(153*(m > 2 ? m-3 : m+9) + 2)/5 + d-1};
+  const unsigned doe{yoe * 365 + yoe/4 - yoe/100 + doy};
+  return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+void civil_from_days(std::int64_t z, std::int64_t &y, unsigned &m, unsigned &d) {
+  z += 719468;
+  const std::int64_t era{(z >= 0 ? z : z - 146096) / 146097};
+  const unsigned doe{static_cast<unsigned>(z - era * 146097)};
+  const unsigned yoe{(doe - doe/1460 + doe/36524 - doe/146096) / 365};
+  const unsigned doy{doe - (365*yoe + yoe/4 - yoe/100)};
+  const unsigned mp{(5*doy + 2)/153};
+  d = doy - (153*mp+2)/5 + 1;
+  m = mp < 10 ? mp+3 : mp-9;
+  y = static_cast<std::int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+std::int64_t to_civil_seconds(const std::chrono::system_clock::time_point &tp) {
+  auto tt{std::chrono::system_clock::to_time_t(tp)};
+  std::tm tm{};
+  localtime_r(&tt, &tm);
+  return days_from_civil(tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday)*86400
+    + tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec;
+}
+
+// Floor division, so that times before 1970 still land in the right day
+std::int64_t civil_day(std::int64_t civil_seconds) {
+  return civil_seconds >= 0 ? civil_seconds/86400
+    : -((-civil_seconds + 86399)/86400);
+}
+
+// Fast path for "YYYY-mm-ddTHH:MM:SS", the only format we ever write
+bool parse_iso(std::string_view str, std::int64_t &out) {
+  if (str.size() != 19 || str[4] != '-' || str[7] != '-' || str[10] != 'T'
+      || str[13] != ':' || str[16] != ':') {
+    return false;
+  }
+  auto digits = [&str](std::size_t pos, std::size_t len, unsigned &val) {
+    val = 0;
+    for (std::size_t i{pos}; i < pos+len; ++i) {
+      unsigned digit{static_cast<unsigned>(str[i] - '0')};
+      if (digit > 9) {
+        return false;
+      }
+      val = val*10 + digit;
+    }
+    return true;
+  };
+  unsigned y, mo, d, h, mi, s;
+  if (!(digits(0, 4, y) && digits(5, 2, mo) && digits(8, 2, d)
+        && digits(11, 2, h) && digits(14, 2, mi) && digits(17, 2, s))) {
+    return false;
+  }
+  if (mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || s > 60) {
+    return false;
+  }
+  out = days_from_civil(y, mo, d)*86400 + h*3600 + mi*60 + s;
+  return true;
+}
+
+// Writes exactly 19 characters, no terminator
+void format_iso(std::int64_t civil_seconds, char *out) {
+  std::int64_t day{civil_day(civil_seconds)}, y;
+  unsigned m, d;
+  civil_from_days(day, y, m, d);
+  unsigned secs{static_cast<unsigned>(civil_seconds - day*86400)};
+  auto put = [&out](unsigned val, int len) {
+    for (int i{len-1}; i >= 0; --i) {
+      out[i] = static_cast<char>('0' + val%10);
+      val /= 10;
+    }
+    out += len;
+  };
+  put(static_cast<unsigned>(y), 4); *out++ = '-';
+  put(m, 2); *out++ = '-';
+  put(d, 2); *out++ = 'T';
+  put(secs/3600, 2); *out++ = ':';
+  put((secs%3600)/60, 2); *out++ = ':';
+  put(secs%60, 2);
+}
+
+std::string civil_to_iso(std::int64_t civil_seconds) {
+  std::string str(19, ' ');
+  format_iso(civil_seconds, str.data());
+  return str;
+}
+
+enum class Phase : std::uint8_t { work, short_break, long_break };
+constexpr std::size_t PHASE_COUNT{3};
+
+const char *phase_name(Phase phase) {
+  switch (phase) {
+    case Phase::work: return "work";
+    case Phase::short_break: return "short_break";
+    case Phase::long_break: return "long_break";
+  }
+  return "work";
+}
+
+// One tracked interval; times are civil seconds (see days_from_civil)
+struct Session {
+  std::int64_t start{0};
+  std::int64_t end{0};
+  Phase phase{Phase::work};
+  // ids into the label dictionary, 0 means none
+  std::uint32_t project{0};
+  std::uint32_t tag{0};
+};
+
+// Minimal cursor over a single ndjson record. We only ever write flat
+// objects, so this never has to build a json tree to read one back.
+struct RecordCursor {
+  std::string_view str;
+  std::size_t pos{0};
+
+  void skip_ws() {
+    while (pos < str.size() && (str[pos] == ' ' || str[pos] == '\t'
+          || str[pos] == '\r' || str[pos] == '\n')) {
+      pos++;
+    }
+  }
+
+  bool consume(char c) {
+    skip_ws();
+    if (pos < str.size() && str[pos] == c) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  // Returns the raw contents between the quotes, escapes are left as-is
+  bool string(std::string_view &out) {
+    if (!consume('"')) {
+      return false;
+    }
+    std::size_t begin{pos};
+    // jump from quote to quote, one is escaped by an odd run of backslashes
+    while (true) {
+      auto quote{static_cast<const char *>(
+          std::memchr(str.data() + pos, '"', str.size() - pos))};
+      if (!quote) {
+        return false;
+      }
+      pos = static_cast<std::size_t>(quote - str.data());
+      std::size_t backslashes{0};
+      while (pos - backslashes > begin && str[pos - backslashes - 1] == '\\') {
+        backslashes++;
+      }
+      if (backslashes % 2 == 0) {
+        break;
+      }
+      pos++;
+    }
+    out = str.substr(begin, pos-begin);
+    pos++;
+    return true;
+  }
+
+  bool uint(std::uint32_t &out) {
+    skip_ws();
+    std::uint64_t val{0};
+    std::size_t begin{pos};
+    while (pos < str.size() && pos-begin < 10
+        && static_cast<unsigned>(str[pos] - '0') <= 9) {
+      val = val*10 + static_cast<unsigned>(str[pos] - '0');
+      pos++;
+    }
+    if (pos == begin || val > UINT32_MAX) {
+      return false;
+    }
+    out = static_cast<std::uint32_t>(val);
+    return true;
+  }
+
+  // Skips any json value, including nested arrays and objects
+  bool skip_value() {
+    skip_ws();
+    if (pos >= str.size()) {
+      return false;
+    }
+    if (str[pos] == '"') {
+      std::string_view ignored;
+      return string(ignored);
+    }
+    if (str[pos] == '{' || str[pos] == '[') {
+      int depth{0};
+      while (pos < str.size()) {
+        char c{str[pos]};
+        if (c == '"') {
+          std::string_view ignored;
+          if (!string(ignored)) {
+            return false;
+          }
+          continue;
+        }
+        depth += (c == '{' || c == '[') - (c == '}' || c == ']');
+        pos++;
+        if (depth == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+    std::size_t begin{pos};
+    while (pos < str.size() && str[pos] != ',' && str[pos] != '}'
+        && str[pos] != ']' && !std::isspace(static_cast<unsigned char>(str[pos]))) {
+      pos++;
+    }
+    return pos > begin;
+  }
+};
+
+bool parse_phase(std::string_view name, Phase &out) {
+  if (name == "work") {
+    out = Phase::work;
+  } else if (name == "short_break") {
+    out = Phase::short_break;
+  } else if (name == "long_break") {
+    out = Phase::long_break;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Keys of a record, for decoding only those a reader needs. Start and end
+// are always decoded.
+enum SessionField : unsigned {
+  FIELD_PHASE = 1,
+  FIELD_PROJECT = 2,
+  FIELD_TAG = 4,
+  FIELD_ALL = 7,
+};
+
+// Decodes one line of the track file, without "phase" it is work. Keys not
+// in fields are skipped, and the line is left once all of them were seen.
+bool decode_session(std::string_view line, Session &out, unsigned fields = FIELD_ALL) {
+  RecordCursor cur{line};
+  if (!cur.consume('{')) {
+    return false;
+  }
+  bool has_start{false}, has_end{false};
+  unsigned seen{0};
+  out.phase = Phase::work;
+  out.project = out.tag = 0;
+  if (cur.consume('}')) {
+    return false;
+  }
+  do {
+    std::string_view key, value;
+    if (!cur.string(key) || !cur.consume(':')) {
+      return false;
+    }
+    if (key == "start" || key == "end" || (key == "phase" && (fields & FIELD_PHASE))) {
+      if (!cur.string(value)) {
+        return false;
+      }
+      if (key == "start") {
+        has_start = parse_iso(value, out.start);
+        if (!has_start) {
+          return false;
+        }
+      } else if (key == "end") {
+        has_end = parse_iso(value, out.end);
+        if (!has_end) {
+          return false;
+        }
+      } else if (!parse_phase(value, out.phase)) {
+        return false;
+      } else {
+        seen |= FIELD_PHASE;
+      }
+    } else if (key == "project" && (fields & FIELD_PROJECT)) {
+      if (!cur.uint(out.project)) {
+        return false;
+      }
+      seen |= FIELD_PROJECT;
+    } else if (key == "tag" && (fields & FIELD_TAG)) {
+      if (!cur.uint(out.tag)) {
+        return false;
+      }
+      seen |= FIELD_TAG;
+    } else if (!cur.skip_value()) {
+      return false;
+    }
+    if (fields != FIELD_ALL && has_start && has_end && seen == fields) {
+      return true;
+    }
+  } while (cur.consume(','));
+  if (!cur.consume('}')) {
+    return false;
+  }
+  cur.skip_ws();
+  return has_start && has_end && cur.pos == line.size();
+}
+
+enum class RecordKey { start, end, phase, project, tag, other };
+
+RecordKey record_key(std::string_view key) {
+  switch (key.size()) {
+    case 3:
+      return key == "end" ? RecordKey::end : key == "tag" ? RecordKey::tag : RecordKey::other;
+    case 5:
+      return key == "start" ? RecordKey::start
+        : key == "phase" ? RecordKey::phase : RecordKey::other;
+    case 7:
+      return key == "project" ? RecordKey::project : RecordKey::other;
+    default:
+      return RecordKey::other;
+  }
+}
+
+// decode_session for a line with its structural positions in pos. Takes the
+// layout encode_session writes only, anything else falls back.
+bool decode_session_indexed(std::string_view line, const std::uint32_t *pos, std::size_t n,
+    Session &out, unsigned fields = FIELD_ALL) {
+  auto fallback = [&] { return decode_session(line, out, fields); };
+  if (line.empty() || line.front() != '{') {
+    return fallback();
+  }
+  bool has_start{false}, has_end{false};
+  unsigned seen{0};
+  out.phase = Phase::work;
+  out.project = out.tag = 0;
+  std::size_t i{0}, expect{1};
+  while (true) {
+    // "key":
+    if (i + 2 >= n || pos[i] != expect || line[pos[i]] != '"' || line[pos[i+1]] != '"'
+        || pos[i+2] != pos[i+1] + 1 || line[pos[i+2]] != ':') {
+      return fallback();
+    }
+    RecordKey key{record_key(std::string_view{line.data() + pos[i] + 1, pos[i+1] - pos[i] - 1})};
+    bool wanted{key == RecordKey::start || key == RecordKey::end
+      || (key == RecordKey::phase && (fields & FIELD_PHASE))
+      || (key == RecordKey::project && (fields & FIELD_PROJECT))
+      || (key == RecordKey::tag && (fields & FIELD_TAG))};
+    std::size_t value{pos[i+2] + 1}, end;
+    i += 3;
+    if (value < line.size() && line[value] == '"') {
+      if (i + 1 >= n || pos[i] != value || line[pos[i+1]] != '"') {
+        return fallback();
+      }
+      std::string_view str{line.data() + value + 1, pos[i+1] - value - 1};
+      end = pos[i+1] + 1;
+      i += 2;
+      if (!wanted) {
+      } else if (key == RecordKey::start) {
+        if (!(has_start = parse_iso(str, out.start))) {
+          return false;
+        }
+      } else if (key == RecordKey::end) {
+        if (!(has_end = parse_iso(str, out.end))) {
+          return false;
+        }
+      } else if (key == RecordKey::phase) {
+        if (!parse_phase(str, out.phase)) {
+          return false;
+        }
+        seen |= FIELD_PHASE;
+      } else {
+        return fallback();
+      }
+    } else if (wanted && (key == RecordKey::project || key == RecordKey::tag)) {
+      RecordCursor cur{line, value};
+      if (!cur.uint(key == RecordKey::project ? out.project : out.tag)) {
+        return false;
+      }
+      seen |= key == RecordKey::project ? FIELD_PROJECT : FIELD_TAG;
+      end = cur.pos;
+    } else if (wanted) {
+      return fallback();
+    } else {
+      // a number or literal we skip, nested values have their own structure
+      end = line.find_first_of(",}{[]", value);
+      if (end == std::string_view::npos || end == value || line[end] == '{' || line[end] == '['
+          || line[end] == ']') {
+        return fallback();
+      }
+    }
+    if (fields != FIELD_ALL && has_start && has_end && seen == fields) {
+      return true;
+    }
+    if (end >= line.size()) {
+      return fallback();
+    }
+    if (line[end] == '}') {
+      return end + 1 == line.size() && i == n ? has_start && has_end : fallback();
+    }
+    if (line[end] != ',') {
+      return fallback();
+    }
+    expect = end + 1;
+  }
+}
+
+// With --checksums records end in ,"crc":"xxxxxxxx"} where the CRC32C
+// covers everything before the comma. Other readers see one more key.
+constexpr std::string_view CRC_KEY{",\"crc\":\""};
+constexpr std::size_t CRC_SUFFIX{CRC_KEY.size() + 8 + 2};
+
+// Appends the key to the record starting at out[begin], before its brace
+void append_record_crc(std::string &out, std::size_t begin) {
+  char hex[9];
+  std::snprintf(hex, sizeof(hex), "%08x",
+      crc32c(std::string_view{out}.substr(begin)));
+  out += CRC_KEY;
+  out.append(hex, 8);
+  out += '"';
+}
+
+enum class RecordCheck { unchecked, ok, corrupt };
+
+// Records without the key are unchecked
+RecordCheck check_record_crc(std::string_view line) {
+  if (line.size() <= CRC_SUFFIX || line.back() != '}' || line[line.size()-2] != '"'
+      || line.substr(line.size() - CRC_SUFFIX, CRC_KEY.size()) != CRC_KEY) {
+    return RecordCheck::unchecked;
+  }
+  std::uint32_t stored{0};
+  for (char c : line.substr(line.size() - 10, 8)) {
+    int digit{c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1};
+    if (digit < 0) {
+      return RecordCheck::corrupt;
+    }
+    stored = stored << 4 | static_cast<std::uint32_t>(digit);
+  }
+  return crc32c(line.substr(0, line.size() - CRC_SUFFIX)) == stored
+    ? RecordCheck::ok : RecordCheck::corrupt;
+}
+
+// Scans skip broken records instead of giving up, each reported once on
+// stderr
+void report_skipped(const std::string &path, std::uint64_t offset, const char *what) {
+  constexpr std::size_t DETAILED{10};
+  static std::mutex mutex;
+  static std::set<std::pair<std::string, std::uint64_t>> seen;
+  std::lock_guard<std::mutex> lock{mutex};
+  if (!seen.emplace(path, offset).second) {
+    return;
+  }
+  if (seen.size() <= DETAILED) {
+    std::cerr << "Skipping " << what << " record in " << path << " at offset " << offset
+      << std::endl;
+  } else if (seen.size() == DETAILED + 1) {
+    std::cerr << "Skipping more broken records, see fsck" << std::endl;
+  }
+}
+
 /* TODO replace me with SDL or sth serious */
 void play_sound() {
   system("play -nq -t alsa synth 0.5 sine 440 vol 0.5");
@@ -89,201 +579,5718 @@ void init_nc() {
   nc::nodelay(nc::stdscr, TRUE);
 }
 
-void write_out_ndjson(
-    const std::chrono::system_clock::time_point &start,
-    const std::chrono::system_clock::time_point &end) {
-  auto json = nlohmann::json{
-    {"start", timepoint_to_iso<std::chrono::system_clock>(start)},
-    {"end", timepoint_to_iso<std::chrono::system_clock>(end)}
-  };
-  auto json_str{json.dump()};
-  debug_print(json_str);
-  std::ofstream ofs(TRACK_FILE, std::ios_base::app);
-  ofs << json_str << std::endl;
-  ofs.close();
+#include "io_uring.hpp"
+
+// Compressed segment: a header, the block index and independently deflated
+// blocks of whole lines. Host byte order:
+//   char magic[8], uint64 count, {uint64 offset, uint32 size, uint32 raw_size}[count]
+constexpr char SEGMENT_MAGIC[8]{'M', 'W', 'S', 'E', 'G', 'Z', '1', 0};
+
+struct SegmentBlock {
+  std::uint64_t offset;
+  std::uint32_t size;
+  std::uint32_t raw_size;
+};
+static_assert(sizeof(SegmentBlock) == 16, "SegmentBlock is read and written as is");
+
+void pread_exact(int fd, char *dst, std::size_t len, std::uint64_t offset) {
+  while (len) {
+    ssize_t n{::pread(fd, dst, len, static_cast<off_t>(offset))};
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      throw std::runtime_error(std::string{"Read failed: "} + std::strerror(errno));
+    }
+    if (n == 0) {
+      throw std::runtime_error("Unexpected end of file");
+    }
+    dst += n;
+    len -= static_cast<std::size_t>(n);
+    offset += static_cast<std::uint64_t>(n);
+  }
 }
 
-void track_main(std::uint64_t pomodoro_count) {
-  std::signal(SIGINT, signal_handler);
-  debug_print("Pomodoro count: ", pomodoro_count);
+// False for anything but a compressed segment
+bool read_segment_index(int fd, std::vector<SegmentBlock> &blocks) {
+  char header[16];
+  ssize_t n;
+  do {
+    n = ::pread(fd, header, sizeof(header), 0);
+  } while (n < 0 && errno == EINTR);
+  if (n != static_cast<ssize_t>(sizeof(header))
+      || std::memcmp(header, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC))) {
+    return false;
+  }
+  std::uint64_t count;
+  std::memcpy(&count, header + 8, sizeof(count));
+  if (count > (1 << 24)) {
+    throw std::runtime_error("Corrupt compressed segment index");
+  }
+  blocks.resize(count);
+  pread_exact(fd, reinterpret_cast<char *>(blocks.data()), count*sizeof(SegmentBlock),
+      sizeof(header));
+  return true;
+}
 
-  std::uint64_t total_seconds{pomodoro_count*60*25};
-  debug_print("Total seconds: ", total_seconds);
-  std::cout << "Enter to stop early" << std::endl;
+void inflate_block(const char *src, std::size_t size, char *dst, std::size_t raw_size) {
+  uLongf len{raw_size};
+  if (::uncompress(reinterpret_cast<Bytef *>(dst), &len, reinterpret_cast<const Bytef *>(src),
+        size) != Z_OK || len != raw_size) {
+    throw std::runtime_error("Corrupt compressed block");
+  }
+}
 
-  init_nc();
+// Whole lines into the compressed layout, blocks of about 1 MiB
+std::string deflate_segment(std::string_view content) {
+  constexpr std::size_t BLOCK{1 << 20};
+  std::vector<std::string_view> raw;
+  while (!content.empty()) {
+    auto nl{content.size() > BLOCK ? content.find('\n', BLOCK - 1) : std::string_view::npos};
+    auto len{nl == std::string_view::npos ? content.size() : nl + 1};
+    raw.push_back(content.substr(0, len));
+    content.remove_prefix(len);
+  }
+  std::vector<SegmentBlock> blocks(raw.size());
+  std::string packed;
+  for (std::size_t i{0}; i < raw.size(); ++i) {
+    if (raw[i].size() > UINT32_MAX) {
+      throw std::runtime_error("Line too long to compress");
+    }
+    uLongf len{::compressBound(raw[i].size())};
+    std::size_t at{packed.size()};
+    packed.resize(at + len);
+    if (::compress2(reinterpret_cast<Bytef *>(packed.data() + at), &len,
+          reinterpret_cast<const Bytef *>(raw[i].data()), raw[i].size(), 6) != Z_OK) {
+      throw std::runtime_error("Compression failed");
+    }
+    packed.resize(at + len);
+    blocks[i] = {at, static_cast<std::uint32_t>(len), static_cast<std::uint32_t>(raw[i].size())};
+  }
+  std::uint64_t count{blocks.size()};
+  std::uint64_t header{sizeof(SEGMENT_MAGIC) + sizeof(count) + count*sizeof(SegmentBlock)};
+  for (auto &block : blocks) {
+    block.offset += header;
+  }
+  std::string out{SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)};
+  out.append(reinterpret_cast<const char *>(&count), sizeof(count));
+  out.append(reinterpret_cast<const char *>(blocks.data()), count*sizeof(SegmentBlock));
+  out += packed;
+  return out;
+}
 
-  int input{1337};
-  uint64_t secs;
-  auto start{std::chrono::system_clock::now()};
-  while (!(input == '\n' || input == 'q' || sigint_recieved)) {
-    secs = seconds_since(start);
+// Reads a file in large blocks and hands out one line at a time. A line is
+// only valid until the next call to next().
+class LineReader {
+ public:
+  // "-" reads stdin
+  explicit LineReader(const std::string &path, std::size_t block_size = 1 << 20)
+    : buf_(block_size), path_{path} {
+    fd_ = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    owns_fd_ = path != "-";
+    start(0, UINT64_MAX);
+  }
 
-    // clear screen
-    nc::clear();
-    std::stringstream first_line;
-    bool time_is_up = secs >= total_seconds;
-    if (time_is_up) {
-      first_line << "Time over since " << format_seconds(secs-total_seconds);
-    } else {
-      first_line << "Time remaining: " << format_seconds(total_seconds-secs);
+  // Only the bytes [begin, end) of a regular file, begin and end have to be
+  // line boundaries
+  LineReader(const std::string &path, std::uint64_t begin, std::uint64_t end,
+      std::size_t block_size = 1 << 20)
+    : buf_(block_size), path_{path} {
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    owns_fd_ = true;
+    if (fd_ >= 0 && !start(begin, end)) {
+      throw std::runtime_error("Could not seek in " + path);
     }
-    nc::mvprintw(0, 0, "%s", first_line.str().c_str());
-    nc::mvprintw(2, 0, "q or enter to stop timer");
-    nc::mvprintw(3, 0, "Debug: Last Input '%d'", input);
-    nc::refresh(); // refresh includes "flush out"
-    nc::napms(500); // sleep
+    consumed_ = line_offset_ = begin;
+    remaining_ = end - begin;
+  }
 
-    // equal to getch(), but without macros
-    input = nc::wgetch(nc::stdscr);
-    if (input == '\n' || input == 'q') {
-      break;
+  LineReader(const LineReader &) = delete;
+  LineReader &operator=(const LineReader &) = delete;
+
+  ~LineReader() {
+    ahead_.reset();
+    if (owns_fd_ && fd_ >= 0) {
+      ::close(fd_);
     }
+  }
 
-    // if time is already up: notify the user every 10 seconds
-    if (time_is_up && ((secs-total_seconds)%10)==0) {
-      play_sound();
+  bool is_open() const { return fd_ >= 0; }
+
+  const std::string &path() const { return path_; }
+
+  // Byte offset of the line last returned by next()
+  std::uint64_t offset() const { return line_offset_; }
+
+  // Every complete line buffered so far, offset() being that of the first.
+  // Valid until the next call.
+  bool next_lines(std::string_view &lines) {
+    while (true) {
+      const char *begin{buf_.data() + begin_};
+      const void *nl{::memrchr(begin, '\n', end_ - begin_)};
+      if (nl || (eof_ && begin_ < end_)) {
+        std::size_t len{nl ? static_cast<std::size_t>(static_cast<const char *>(nl) - begin) + 1
+          : end_ - begin_};
+        lines = std::string_view{begin, len};
+        line_offset_ = consumed_;
+        consumed_ += len;
+        begin_ += len;
+        return true;
+      }
+      if (eof_) {
+        return false;
+      }
+      fill();
     }
   }
 
-  nc::endwin();
+  bool next(std::string_view &line) {
+    while (true) {
+      const char *begin{buf_.data() + begin_};
+      const void *nl{std::memchr(begin, '\n', end_ - begin_)};
+      if (nl) {
+        std::size_t len{static_cast<std::size_t>(static_cast<const char *>(nl) - begin)};
+        line = std::string_view{begin, len};
+        line_offset_ = consumed_;
+        consumed_ += len+1;
+        begin_ += len+1;
+        return true;
+      }
+      if (eof_) {
+        if (begin_ == end_) {
+          return false;
+        }
+        // last line without trailing newline
+        line = std::string_view{begin, end_ - begin_};
+        line_offset_ = consumed_;
+        consumed_ += end_ - begin_;
+        begin_ = end_;
+        return true;
+      }
+      fill();
+    }
+  }
 
-  auto end{std::chrono::system_clock::now()};
-  auto delta{std::chrono::duration_cast<std::chrono::seconds>(end-start)};
-  std::cout << "Successfully worked for " << delta.count() << " seconds!"
-    << std::endl;
+ private:
+  void fill() {
+    if (fd_ < 0) {
+      eof_ = true;
+      return;
+    }
+    // keep the partial line, grow only if a single line exceeds the block
+    std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+    if (end_ == buf_.size()) {
+      buf_.resize(buf_.size()*2);
+    }
+    if (compressed_) {
+      if (next_packed_ == packed_.size()) {
+        eof_ = true;
+        return;
+      }
+      const auto &entry{packed_[next_packed_++]};
+      if (buf_.size() - end_ < entry.raw_size) {
+        buf_.resize(end_ + entry.raw_size);
+      }
+      if (scratch_.size() < entry.size) {
+        scratch_.resize(entry.size);
+      }
+      pread_exact(fd_, scratch_.data(), entry.size, entry.offset);
+      inflate_block(scratch_.data(), entry.size, buf_.data() + end_, entry.raw_size);
+      end_ += entry.raw_size;
+      return;
+    }
+    std::size_t want{static_cast<std::size_t>(std::min<std::uint64_t>(
+          buf_.size() - end_, remaining_))};
+    ssize_t n{0};
+    if (want && ahead_) {
+      n = static_cast<ssize_t>(ahead_->read(buf_.data() + end_, want));
+    } else if (want) {
+      do {
+        n = seekable_ ? ::pread(fd_, buf_.data() + end_, want, static_cast<off_t>(position_))
+          : ::read(fd_, buf_.data() + end_, want);
+      } while (n < 0 && errno == EINTR);
+    }
+    if (n < 0) {
+      throw std::runtime_error(std::string{"Read failed: "} + std::strerror(errno));
+    }
+    eof_ = n == 0;
+    end_ += static_cast<std::size_t>(n);
+    remaining_ -= static_cast<std::uint64_t>(n);
+    position_ += static_cast<std::uint64_t>(n);
+  }
 
-  write_out_ndjson(start, end);
-  debug_print("end track");
-}
+  // Ranges of compressed segments are in inflated bytes and start with a
+  // block. False if a range was asked of something not a regular file.
+  bool start(std::uint64_t begin, std::uint64_t end) {
+    if (fd_ < 0) {
+      return true;
+    }
+    struct stat st;
+    seekable_ = ::fstat(fd_, &st) == 0 && S_ISREG(st.st_mode);
+    if (!seekable_) {
+      return begin == 0;
+    }
+    std::vector<SegmentBlock> packed;
+    if (read_segment_index(fd_, packed)) {
+      std::uint64_t raw{0};
+      for (const auto &entry : packed) {
+        if (raw >= begin && raw < end) {
+          packed_.push_back(entry);
+        }
+        raw += entry.raw_size;
+      }
+      compressed_ = true;
+      return true;
+    }
+    position_ = begin;
+    if (use_io_uring) {
+      ahead_ = UringReadAhead::open(fd_, begin, end, buf_.size());
+    }
+    return true;
+  }
 
-void report_main() {
-  std::vector<nlohmann::json> xs;
-  std::ifstream ifs(TRACK_FILE);
-  std::string buf;
-  while (std::getline(ifs, buf)) {
-    xs.emplace_back(nlohmann::json::parse(buf));
+  std::vector<char> buf_;
+  std::string path_;
+  std::size_t begin_{0}, end_{0};
+  std::uint64_t consumed_{0}, line_offset_{0}, remaining_{UINT64_MAX}, position_{0};
+  int fd_{-1};
+  bool owns_fd_{false};
+  bool seekable_{false};
+  bool eof_{false};
+  std::unique_ptr<UringReadAhead> ahead_;
+  // the blocks of a compressed segment still to inflate
+  bool compressed_{false};
+  std::vector<SegmentBlock> packed_;
+  std::size_t next_packed_{0};
+  std::vector<char> scratch_;
+};
+
+// Collects output and hands it to the kernel in big writes. With
+// --io-uring the next buffer fills while the last one is written.
+class OutputBuffer {
+ public:
+  // "-" writes to stdout, mode is O_TRUNC or O_APPEND
+  explicit OutputBuffer(const std::string &path, std::size_t size = 4 << 20, int mode = O_TRUNC) {
+    if (path == "-") {
+      fd_ = STDOUT_FILENO;
+    } else {
+      fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | mode, 0644);
+      owns_fd_ = true;
+      if (fd_ < 0) {
+        throw std::runtime_error("Could not open " + path);
+      }
+    }
+    if (use_io_uring) {
+      behind_ = UringWriteBehind::open(fd_, size);
+    }
+    if (behind_) {
+      data_ = behind_->block();
+    } else {
+      buf_.resize(size);
+      data_ = buf_.data();
+    }
+    size_ = size;
   }
-  // TODO continue here
-}
 
-std::string get_current_date_string() {
-  auto now = std::chrono::system_clock::now();
-  std::time_t now_c = std::chrono::system_clock::to_time_t(now);
-  std::tm local_tm = *std::localtime(&now_c);
-  std::ostringstream date_stream;
-  date_stream << std::put_time(&local_tm, "%Y-%m-%d");
-  return date_stream.str();
-}
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
 
-// Assuming
-// YYYY-mm-dd and hh-mm
-// NOTICE NO SECONDS
-std::chrono::system_clock::time_point parse_datetime(const std::string& date_str,
-    const std::string& time_str) {
-    std::tm tm = {};
-    std::istringstream ss(date_str + " " + time_str);
-    ss >> std::get_time(&tm, "%Y-%m-%d %H:%M");
-    auto tp = std::chrono::system_clock::from_time_t(std::mktime(&tm));
-    return tp;
-}
+  ~OutputBuffer() {
+    behind_.reset();
+    if (owns_fd_) {
+      ::close(fd_);
+    }
+  }
 
-// Assuming yyyy-mm-dd
-bool validate_date(std::string maybe_date) {
-  // allow for left_whitespace
-  size_t left_idx{0};
-  while (left_idx < maybe_date.size() && std::isspace(maybe_date[left_idx])) {
-    left_idx++;
+  int fd() const { return fd_; }
+
+  // Returns space for at least n bytes, to be confirmed with commit()
+  char *claim(std::size_t n) {
+    if (used_ + n > size_) {
+      spill();
+      if (n > size_) {
+        // the registered buffers cannot grow, go on with plain writes
+        if (behind_) {
+          behind_->wait();
+          behind_.reset();
+        }
+        buf_.resize(n);
+        data_ = buf_.data();
+        size_ = n;
+      }
+    }
+    return data_ + used_;
   }
-  // TODO continue, also check that nothing is afterwards
-  return false;
-}
 
+  void commit(std::size_t n) { used_ += n; }
 
-void add_main() {
-  // was it today
-  std::string buf;
-  std::cout << "Was it today? (y/n)" << std::endl;
-  std::getline(std::cin, buf); // used to get rid of newline
-  bool was_it_today;
-  char answer = std::tolower(buf[0]);
-  if (answer == 'y') {
-    was_it_today = true;
-  } else if (answer == 'n') {
-    was_it_today = false;
-  } else {
-    was_it_today = false;
-    std::cout << "Not understood... I am assuming it was today" << std::endl;
+  void append(std::string_view str) {
+    std::memcpy(claim(str.size()), str.data(), str.size());
+    commit(str.size());
   }
 
-  std::string start_date, end_date, start_time, end_time;
+  void append_iso(std::int64_t civil_seconds) {
+    format_iso(civil_seconds, claim(19));
+    commit(19);
+  }
 
-  // get start and end date
-  if (!was_it_today) {
-    // TODO make it run iteratively if it does not fit the format
-    std::cout << "Enter start date (YYYY-mm-dd): ";
-    std::getline(std::cin, start_date);
-    std::cout << "Enter end date (YYYY-mm-dd): ";
-    std::getline(std::cin, end_date);
-  } else {
-    // Automatically set today's date
-    start_date = end_date = get_current_date_string();
+  // Flushes and waits until the data reached the disk
+  void sync() {
+    flush();
+    if (::fdatasync(fd_) < 0) {
+      throw std::runtime_error(std::string{"fdatasync failed: "} + std::strerror(errno));
+    }
   }
-  debug_print("Start Date ", start_date);
-  debug_print("End Date ", end_date);
 
-  // get start and end time
-  // TODO make it run iteratively if it does not fit the format
-  std::cout << "Enter start time (hh:mm): ";
-  std::getline(std::cin, start_time);
-  std::cout << "Enter end time (hh:mm): ";
-  std::getline(std::cin, end_time);
+  void flush() {
+    spill();
+    if (behind_) {
+      behind_->wait();
+    }
+  }
+
+ private:
+  // Hands the buffer to the kernel, only waits for it without io_uring
+  void spill() {
+    if (behind_) {
+      behind_->write(used_);
+      data_ = behind_->block();
+      used_ = 0;
+      return;
+    }
+    std::size_t done{0};
+    while (done < used_) {
+      ssize_t n{::write(fd_, buf_.data() + done, used_ - done)};
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(std::string{"Write failed: "} + std::strerror(errno));
+      }
+      done += static_cast<std::size_t>(n);
+    }
+    used_ = 0;
+  }
+
+  std::vector<char> buf_;
+  std::unique_ptr<UringWriteBehind> behind_;
+  char *data_{nullptr};
+  std::size_t used_{0}, size_{0};
+  int fd_{-1};
+  bool owns_fd_{false};
+};
 
-  // write out
-  auto start_tp = parse_datetime(start_date, start_time);
-  auto end_tp = parse_datetime(end_date, end_time);
-  write_out_ndjson(start_tp, end_tp);
+// Same layout nlohmann would produce for the record, minus the tree
+void encode_session(const Session &session, std::string &out) {
+  std::size_t begin{out.size()};
+  char iso[19];
+  out += "{\"start\":\"";
+  format_iso(session.start, iso);
+  out.append(iso, sizeof(iso));
+  out += "\",\"end\":\"";
+  format_iso(session.end, iso);
+  out.append(iso, sizeof(iso));
+  out += "\",\"phase\":\"";
+  out += phase_name(session.phase);
+  out += '"';
+  if (session.project) {
+    out += ",\"project\":";
+    out += std::to_string(session.project);
+  }
+  if (session.tag) {
+    out += ",\"tag\":";
+    out += std::to_string(session.tag);
+  }
+  if (write_checksums) {
+    append_record_crc(out, begin);
+  }
+  out += "}\n";
 }
 
-int main(int argc, char **argv) {
-  argparse::ArgumentParser program("mywarrior", "0.0.1");
+// Append-only list of project and tag names. Records only store the id,
+// which is the line number in the dictionary file (starting at 1).
+class Dictionary {
+ public:
+  static Dictionary load() {
+    Dictionary dict;
+    std::ifstream ifs(DICT_FILE);
+    std::string name;
+    while (std::getline(ifs, name)) {
+      dict.ids_.emplace(name, static_cast<std::uint32_t>(dict.names_.size()));
+      dict.names_.push_back(std::move(name));
+    }
+    return dict;
+  }
 
-  argparse::ArgumentParser track_command("track");
-  track_command.add_description("Tracks pomodori");
-  track_command.add_argument("pomodori")
-    .help("The amount of pomodori (25min) done in a row")
-    .scan<'i', int>();
+  // 0 if the name was never interned
+  std::uint32_t find(const std::string &name) const {
+    auto it{ids_.find(name)};
+    return it == ids_.end() ? 0 : it->second;
+  }
 
-  argparse::ArgumentParser report_command("report");
-  report_command.add_description("provides report of recent work");
+  std::uint32_t intern(const std::string &name) {
+    if (name.empty() || name.find('\n') != std::string::npos) {
+      throw std::runtime_error("Labels have to be a single non-empty line");
+    }
+    if (auto id = find(name)) {
+      return id;
+    }
+    std::ofstream ofs(DICT_FILE, std::ios_base::app);
+    ofs << name << '\n';
+    ofs.close();
+    if (!ofs) {
+      throw std::runtime_error("Could not append to " + DICT_FILE);
+    }
+    auto id{static_cast<std::uint32_t>(names_.size())};
+    ids_.emplace(name, id);
+    names_.push_back(name);
+    return id;
+  }
 
-  argparse::ArgumentParser add_command("add");
-  add_command.add_description("Add manually tracked time");
+  // Highest id + 1, the size of a flat array indexed by id
+  std::size_t size() const { return names_.size(); }
 
-  program.add_subparser(track_command);
-  program.add_subparser(report_command);
-  program.add_subparser(add_command);
+  const std::string &name(std::uint32_t id) const {
+    static const std::string unknown{"<unknown>"};
+    return id < names_.size() ? names_[id] : unknown;
+  }
 
-  try {
-    program.parse_args(argc, argv);
-  } catch (const std::exception &err) {
-    std::cerr << err.what() << std::endl;
-    std::cerr << program;
-    return EXIT_FAILURE;
+ private:
+  std::vector<std::string> names_{""};
+  std::unordered_map<std::string, std::uint32_t> ids_;
+};
+
+// Identifies a version of the track file, derived files remember the stamp
+// they were built from
+struct TrackStamp {
+  std::uint64_t size{0};
+  std::int64_t mtime_ns{0};
+
+  bool operator==(const TrackStamp &other) const {
+    return size == other.size && mtime_ns == other.mtime_ns;
   }
+};
 
-  if (program.is_subcommand_used("track")) {
-    debug_print("Starting Track");
-    int pomodori{track_command.get<int>("pomodori")};
-    track_main(pomodori);
-    return EXIT_SUCCESS;
-  } else if (program.is_subcommand_used("report")) {
-    debug_print("Starting Report");
-    report_main();
-    return EXIT_SUCCESS;
-  } else if (program.is_subcommand_used("add")) {
-    debug_print("Starting Add");
-    add_main();
+TrackStamp stamp_of(const struct stat &st) {
+  return TrackStamp{static_cast<std::uint64_t>(st.st_size),
+    static_cast<std::int64_t>(st.st_mtim.tv_sec)*1000000000 + st.st_mtim.tv_nsec};
+}
+
+const std::string MANIFEST_FILE{"mywarrior.manifest"};
+// Sessions added out of order, a sorted run per batch until rotate or
+// compact merge them
+const std::string LATE_FILE{"mywarrior.late.ndjson"};
+// Records deleted or replaced by edit, until compact drops them
+const std::string TOMBSTONE_FILE{"mywarrior.tombstones"};
+
+// The stamp of the whole log: the track file's with those of the manifest,
+// the late run and the tombstones folded in
+TrackStamp with_manifest(TrackStamp stamp) {
+  for (const auto &path : {MANIFEST_FILE, LATE_FILE, TOMBSTONE_FILE}) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) {
+      TrackStamp other{stamp_of(st)};
+      stamp.size += other.size;
+      stamp.mtime_ns ^= other.mtime_ns;
+    }
+  }
+  return stamp;
+}
+
+// A missing or empty track file has the zero stamp
+TrackStamp track_stamp() {
+  struct stat st;
+  if (::stat(TRACK_FILE.c_str(), &st) != 0 || st.st_size == 0) {
+    return with_manifest(TrackStamp{});
+  }
+  return with_manifest(stamp_of(st));
+}
+
+// A closed month of the log, moved out of the track file by rotate. It
+// never changes afterwards, so what the manifest says about it stays true.
+struct Segment {
+  // "YYYY-MM" of the starts of its sessions
+  std::string month;
+  // stored in the compressed layout, see deflate_segment
+  bool compressed{false};
+  std::uint64_t records{0};
+  std::uint64_t bytes{0};
+  // FNV-1a of the file
+  std::uint64_t checksum{0};
+  std::int64_t min_start{INT64_MAX};
+  std::int64_t max_start{INT64_MIN};
+  std::int64_t max_end{INT64_MIN};
+  // worked seconds per day from the day of min_start on
+  std::vector<std::int64_t> daily;
+
+  std::string path() const {
+    return "mywarrior." + month + (compressed ? ".mwz" : ".ndjson");
+  }
+
+  // Whether sessions overlapping [from, to) can be in it
+  bool overlaps(std::int64_t from, std::int64_t to) const {
+    return max_end > from && min_start < to;
+  }
+};
+
+// version 1 had no codec column, all of its segments are plain
+constexpr std::string_view MANIFEST_HEADER_V1{"mywarrior-manifest 1"};
+constexpr std::string_view MANIFEST_HEADER{"mywarrior-manifest 2"};
+
+std::uint64_t fnv1a(std::string_view data, std::uint64_t hash = 14695981039346656037ull) {
+  for (unsigned char c : data) {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// The closed segments in month order. A line per segment after the header:
+//   month codec records bytes checksum min_start max_start max_end days daily...
+std::vector<Segment> load_manifest() {
+  std::vector<Segment> segments;
+  std::ifstream ifs(MANIFEST_FILE);
+  std::string line;
+  if (!std::getline(ifs, line)) {
+    return segments;
+  }
+  bool v1{line == MANIFEST_HEADER_V1};
+  if (!v1 && line != MANIFEST_HEADER) {
+    throw std::runtime_error("Unknown format of " + MANIFEST_FILE);
+  }
+  while (std::getline(ifs, line)) {
+    std::istringstream fields{line};
+    Segment segment;
+    std::string codec{"plain"}, min_start, max_start, max_end;
+    std::size_t days{0};
+    fields >> segment.month;
+    if (!v1) {
+      fields >> codec;
+    }
+    segment.compressed = codec == "deflate";
+    fields >> segment.records >> segment.bytes >> std::hex >> segment.checksum
+      >> std::dec >> min_start >> max_start >> max_end >> days;
+    if (fields) {
+      segment.daily.resize(std::min<std::size_t>(days, 1 << 20));
+      for (auto &secs : segment.daily) {
+        fields >> secs;
+      }
+    }
+    if (!fields || (codec != "plain" && codec != "deflate")
+        || !parse_iso(min_start, segment.min_start)
+        || !parse_iso(max_start, segment.max_start) || !parse_iso(max_end, segment.max_end)) {
+      throw std::runtime_error("Malformed segment in " + MANIFEST_FILE + ": " + line);
+    }
+    segments.push_back(std::move(segment));
+  }
+  return segments;
+}
+
+// Written to a temporary file and renamed, readers never see half a manifest
+void save_manifest(std::vector<Segment> segments) {
+  std::sort(segments.begin(), segments.end(),
+      [](const Segment &a, const Segment &b) { return a.month < b.month; });
+  const std::string tmp_path{MANIFEST_FILE + ".tmp"};
+  std::ofstream ofs(tmp_path, std::ios_base::trunc);
+  ofs << MANIFEST_HEADER << '\n';
+  for (const auto &segment : segments) {
+    ofs << segment.month << ' ' << (segment.compressed ? "deflate" : "plain") << ' '
+      << segment.records << ' ' << segment.bytes << ' ' << std::hex
+      << segment.checksum << std::dec << ' ' << civil_to_iso(segment.min_start) << ' '
+      << civil_to_iso(segment.max_start) << ' ' << civil_to_iso(segment.max_end) << ' '
+      << segment.daily.size();
+    for (auto secs : segment.daily) {
+      ofs << ' ' << secs;
+    }
+    ofs << '\n';
+  }
+  ofs.close();
+  if (!ofs || std::rename(tmp_path.c_str(), MANIFEST_FILE.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("Could not write " + MANIFEST_FILE);
+  }
+}
+
+// The sorted runs of the log: the segments overlapping [from, to), the
+// track file and the late run, itself made of sorted runs (see late_ranges)
+std::vector<std::vector<std::string>> log_runs(std::int64_t from = INT64_MIN,
+    std::int64_t to = INT64_MAX) {
+  std::vector<std::string> segments;
+  for (const auto &segment : load_manifest()) {
+    if (segment.overlaps(from, to)) {
+      segments.push_back(segment.path());
+    }
+  }
+  return {std::move(segments), {TRACK_FILE}, {LATE_FILE}};
+}
+
+// Byte ranges of the sorted runs of the late run. A batch of late arrivals
+// is appended sorted, so a run ends where a start goes back in time.
+std::vector<std::pair<std::uint64_t, std::uint64_t>> late_ranges() {
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+  LineReader reader{LATE_FILE};
+  std::string_view line;
+  Session session;
+  std::uint64_t begin{0};
+  std::int64_t prev_start{INT64_MIN};
+  bool empty{true};
+  while (reader.next(line)) {
+    // broken records stay in the run they are in, readers skip them
+    if (line.empty() || !decode_session(line, session, 0)) {
+      continue;
+    }
+    if (session.start < prev_start) {
+      ranges.emplace_back(begin, reader.offset());
+      begin = reader.offset();
+    }
+    prev_start = session.start;
+    empty = false;
+  }
+  if (!empty) {
+    ranges.emplace_back(begin, UINT64_MAX);
+  }
+  return ranges;
+}
+
+// The files of the log, for readers that do not care about the order
+std::vector<std::string> track_files(std::int64_t from = INT64_MIN,
+    std::int64_t to = INT64_MAX) {
+  std::vector<std::string> paths;
+  for (auto &run : log_runs(from, to)) {
+    paths.insert(paths.end(), run.begin(), run.end());
+  }
+  return paths;
+}
+
+// Records deleted or replaced, named by start and the FNV-1a of the line,
+// a line each: start hash
+class Tombstones {
+ public:
+  static Tombstones load() {
+    Tombstones dead;
+    std::ifstream ifs(TOMBSTONE_FILE);
+    std::string line;
+    while (std::getline(ifs, line)) {
+      std::istringstream fields{line};
+      std::string start;
+      std::uint64_t hash;
+      std::int64_t civil;
+      if (!(fields >> start >> std::hex >> hash) || !parse_iso(start, civil)) {
+        throw std::runtime_error("Malformed tombstone in " + TOMBSTONE_FILE + ": " + line);
+      }
+      dead.starts_.insert(civil);
+      dead.hashes_.insert(hash);
+    }
+    return dead;
+  }
+
+  bool empty() const { return hashes_.empty(); }
+
+  // Whether the record line starting at start is dead, the start alone
+  // rules out almost all of them
+  bool contains(std::int64_t start, std::string_view line) const {
+    return !starts_.empty() && starts_.count(start) && hashes_.count(fnv1a(line));
+  }
+
+  // Whether a dead record can start in [from, to]
+  bool any_in(std::int64_t from, std::int64_t to) const {
+    return std::any_of(starts_.begin(), starts_.end(),
+        [&](std::int64_t start) { return start >= from && start <= to; });
+  }
+
+ private:
+  std::unordered_set<std::int64_t> starts_;
+  std::unordered_set<std::uint64_t> hashes_;
+};
+
+// Loaded once, the commands changing them are done reading by then
+const Tombstones &tombstones() {
+  static const Tombstones dead{Tombstones::load()};
+  return dead;
+}
+
+// Calls fn(line, offset, pos, n) for the lines of a block of whole lines,
+// with the n structural positions of each relative to the line
+template <typename Fn>
+void for_each_indexed_line(std::string_view lines, std::uint64_t offset, StructuralIndex &index,
+    Fn &&fn) {
+  index.clear();
+  structural_index(lines.data(), lines.size(), index);
+  std::size_t begin{0}, first{0};
+  for (std::size_t i{0}; i <= index.size(); ++i) {
+    if (i < index.size() && lines[index[i]] != '\n') {
+      continue;
+    }
+    std::size_t end{i < index.size() ? index[i] : lines.size()};
+    if (end > begin) {
+      for (std::size_t j{first}; j < i; ++j) {
+        index[j] -= static_cast<std::uint32_t>(begin);
+      }
+      fn(lines.substr(begin, end - begin), offset + begin, index.data() + first, i - first);
+    }
+    begin = end + 1;
+    first = i + 1;
+  }
+}
+
+// Calls fn(session) or fn(session, line) for the live, valid records of a
+// block starting in [from, to), the others dropped by their leading start
+template <typename Fn>
+void for_each_session_in_block(const std::string &path, std::string_view lines,
+    std::uint64_t offset, StructuralIndex &index, std::int64_t from, std::int64_t to,
+    unsigned fields, Fn &&fn) {
+  constexpr std::string_view PREFIX{"{\"start\":\""};
+  bool bounded{from != INT64_MIN || to != INT64_MAX};
+  const Tombstones &dead{tombstones()};
+  Session session;
+  for_each_indexed_line(lines, offset, index, [&](std::string_view line,
+        std::uint64_t line_offset, const std::uint32_t *pos, std::size_t n) {
+    std::int64_t start;
+    if (bounded && line.size() > PREFIX.size() + 19 && line.substr(0, PREFIX.size()) == PREFIX
+        && line[PREFIX.size() + 19] == '"' && parse_iso(line.substr(PREFIX.size(), 19), start)
+        && (start < from || start >= to)) {
+      return;
+    }
+    if (check_record_crc(line) == RecordCheck::corrupt) {
+      report_skipped(path, line_offset, "corrupt");
+      return;
+    }
+    if (!decode_session_indexed(line, pos, n, session, fields) || session.end <= session.start) {
+      report_skipped(path, line_offset, "malformed");
+      return;
+    }
+    if (session.start >= from && session.start < to && !dead.contains(session.start, line)) {
+      if constexpr (std::is_invocable_v<Fn &, const Session &, std::string_view>) {
+        fn(session, line);
+      } else {
+        fn(session);
+      }
+    }
+  });
+}
+
+// Like for_each_session_in, but only for sessions starting in [from, to)
+template <typename Fn>
+void for_each_session_starting_in(LineReader &reader, std::int64_t from, std::int64_t to,
+    Fn &&fn, unsigned fields = FIELD_ALL) {
+  std::string_view lines;
+  StructuralIndex index;
+  while (reader.next_lines(lines)) {
+    for_each_session_in_block(reader.path(), lines, reader.offset(), index, from, to, fields, fn);
+  }
+}
+
+template <typename Fn>
+void for_each_session_in(LineReader &reader, Fn &&fn, unsigned fields = FIELD_ALL) {
+  for_each_session_starting_in(reader, INT64_MIN, INT64_MAX, std::forward<Fn>(fn), fields);
+}
+
+// Reads one sorted run of the log a block at a time, file after file, or
+// the bytes [begin, end) of a single file
+class RunCursor {
+ public:
+  RunCursor(std::vector<std::string> paths, std::int64_t from, std::int64_t to,
+      unsigned fields)
+    : paths_{std::move(paths)}, from_{from}, to_{to}, fields_{fields} {}
+
+  RunCursor(const std::string &path, std::uint64_t begin, std::uint64_t end,
+      std::int64_t from, std::int64_t to, unsigned fields)
+    : paths_{path}, begin_{begin}, end_{end}, from_{from}, to_{to}, fields_{fields} {}
+
+  // false once the run is exhausted
+  bool valid() { return pos_ < batch_.size() || refill(); }
+  const Session &session() const { return batch_[pos_].first; }
+  // valid until the cursor moves past the block it is in
+  std::string_view line() const { return batch_[pos_].second; }
+  void next() { pos_++; }
+
+ private:
+  bool refill() {
+    batch_.clear();
+    pos_ = 0;
+    std::string_view lines;
+    while (batch_.empty()) {
+      if (!reader_ || !reader_->next_lines(lines)) {
+        if (next_path_ == paths_.size()) {
+          return false;
+        }
+        // there may be many runs of late arrivals, they get small blocks
+        reader_ = begin_ || end_ != UINT64_MAX
+          ? std::make_unique<LineReader>(paths_[next_path_++], begin_, end_,
+              static_cast<std::size_t>(std::min<std::uint64_t>(end_ - begin_, 64 << 10)))
+          : std::make_unique<LineReader>(paths_[next_path_++]);
+        continue;
+      }
+      for_each_session_in_block(reader_->path(), lines, reader_->offset(), index_, from_, to_,
+          fields_, [this](const Session &session, std::string_view line) {
+        batch_.emplace_back(session, line);
+      });
+    }
+    return true;
+  }
+
+  std::vector<std::string> paths_;
+  std::uint64_t begin_{0}, end_{UINT64_MAX};
+  std::size_t next_path_{0};
+  std::unique_ptr<LineReader> reader_;
+  StructuralIndex index_;
+  std::vector<std::pair<Session, std::string_view>> batch_;
+  std::size_t pos_{0};
+  std::int64_t from_;
+  std::int64_t to_;
+  unsigned fields_;
+};
+
+// Calls fn(session, line) for the records starting in [from, to) in start
+// order, a k-way merge of the sorted runs, ties in run order
+template <typename Fn>
+void for_each_record_in_order(std::int64_t from, std::int64_t to, unsigned fields, Fn &&fn) {
+  auto all{log_runs(from, to)};
+  // the late run comes last, it is read as the runs it is made of
+  all.pop_back();
+  std::vector<RunCursor> runs;
+  for (auto &paths : all) {
+    runs.emplace_back(std::move(paths), from, to, fields);
+  }
+  for (const auto &[begin, end] : late_ranges()) {
+    runs.emplace_back(LATE_FILE, begin, end, from, to, fields);
+  }
+  // a heap of the runs not exhausted yet, by their head and then run order
+  std::vector<std::size_t> heap;
+  auto later = [&runs](std::size_t a, std::size_t b) {
+    std::int64_t a_start{runs[a].session().start}, b_start{runs[b].session().start};
+    return a_start > b_start || (a_start == b_start && a > b);
+  };
+  for (std::size_t i{0}; i < runs.size(); ++i) {
+    if (runs[i].valid()) {
+      heap.push_back(i);
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), later);
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    RunCursor &first{runs[heap.back()]};
+    fn(first.session(), first.line());
+    first.next();
+    if (first.valid()) {
+      std::push_heap(heap.begin(), heap.end(), later);
+    } else {
+      heap.pop_back();
+    }
+  }
+}
+
+// Calls fn for every record of the log in start order
+template <typename Fn>
+void for_each_session(Fn &&fn, unsigned fields = FIELD_ALL) {
+  for_each_record_in_order(INT64_MIN, INT64_MAX, fields,
+      [&fn](const Session &session, std::string_view) { fn(session); });
+}
+
+// Splits a file of size bytes into up to n byte ranges that start at line
+// boundaries
+std::vector<std::uint64_t> split_file(const std::string &path, std::uint64_t size,
+    std::size_t n) {
+  std::vector<std::uint64_t> bounds{0};
+  int fd{::open(path.c_str(), O_RDONLY)};
+  if (fd < 0 || size == 0) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    bounds.push_back(0);
+    return bounds;
+  }
+  char buf[4096];
+  for (std::size_t i{1}; i < n; ++i) {
+    std::uint64_t pos{std::max(bounds.back(), size*i/n)};
+    // move forward to just after the next newline
+    while (pos < size) {
+      ssize_t got{::pread(fd, buf, sizeof(buf), static_cast<off_t>(pos))};
+      if (got <= 0) {
+        pos = size;
+        break;
+      }
+      const void *nl{std::memchr(buf, '\n', static_cast<std::size_t>(got))};
+      if (nl) {
+        pos += static_cast<std::uint64_t>(static_cast<const char *>(nl) - buf) + 1;
+        break;
+      }
+      pos += static_cast<std::uint64_t>(got);
+    }
+    if (pos < size && pos > bounds.back()) {
+      bounds.push_back(pos);
+    }
+  }
+  ::close(fd);
+  bounds.push_back(size);
+  return bounds;
+}
+
+// A line aligned byte range [begin, end) of one file of the log
+struct TrackRange {
+  std::string path;
+  std::uint64_t begin;
+  std::uint64_t end;
+};
+
+// Splits the files overlapping [from, to) into about n line aligned ranges,
+// at least one per non-empty file
+std::vector<TrackRange> split_track(std::size_t n, std::int64_t from = INT64_MIN,
+    std::int64_t to = INT64_MAX) {
+  struct File {
+    std::string path;
+    // inflated for compressed segments, which are split between blocks
+    std::uint64_t size;
+    std::vector<std::uint64_t> block_starts;
+  };
+  std::vector<File> files;
+  std::uint64_t total{0};
+  for (auto &path : track_files(from, to)) {
+    int fd{::open(path.c_str(), O_RDONLY)};
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0 || st.st_size == 0) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      continue;
+    }
+    File file{std::move(path), static_cast<std::uint64_t>(st.st_size), {}};
+    std::vector<SegmentBlock> packed;
+    try {
+      if (read_segment_index(fd, packed)) {
+        file.size = 0;
+        for (const auto &entry : packed) {
+          file.block_starts.push_back(file.size);
+          file.size += entry.raw_size;
+        }
+      }
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+    total += file.size;
+    files.push_back(std::move(file));
+  }
+  std::vector<TrackRange> ranges;
+  for (const auto &file : files) {
+    std::size_t pieces{std::max<std::size_t>(1, n*file.size/std::max<std::uint64_t>(total, 1))};
+    std::vector<std::uint64_t> bounds;
+    if (file.block_starts.empty()) {
+      bounds = split_file(file.path, file.size, pieces);
+    } else {
+      bounds.push_back(0);
+      for (std::size_t i{1}; i < pieces; ++i) {
+        auto it{std::lower_bound(file.block_starts.begin(), file.block_starts.end(),
+            file.size*i/pieces)};
+        if (it != file.block_starts.end() && *it > bounds.back()) {
+          bounds.push_back(*it);
+        }
+      }
+      bounds.push_back(file.size);
+    }
+    for (std::size_t i{0}; i+1 < bounds.size(); ++i) {
+      ranges.push_back({file.path, bounds[i], bounds[i+1]});
+    }
+  }
+  return ranges;
+}
+
+// Implicit augmented interval tree over the sessions sorted by start, as in
+// Heng Li's cgranges: node i is on level ctz(~i) and keeps its subtree's max end
+class IntervalTree {
+ public:
+  struct Node {
+    std::int64_t start;
+    std::int64_t end;
+    std::int64_t max_end;
+    Phase phase;
+  };
+
+  IntervalTree() = default;
+
+  explicit IntervalTree(const std::vector<Session> &sessions) {
+    nodes_.reserve(sessions.size());
+    for (const auto &session : sessions) {
+      nodes_.push_back({session.start, session.end, session.end, session.phase});
+    }
+    std::sort(nodes_.begin(), nodes_.end(),
+        [](const Node &a, const Node &b) { return a.start < b.start; });
+    index();
+  }
+
+  std::size_t size() const { return nodes_.size(); }
+
+  // Sorted by start
+  const std::vector<Node> &nodes() const { return nodes_; }
+
+  // Calls fn for every node overlapping [start, end), in start order
+  template <typename Fn>
+  void overlapping(std::int64_t start, std::int64_t end, Fn &&fn) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    struct Cell { int level; std::int64_t x; bool left_done; };
+    Cell stack[64];
+    int top{0};
+    const auto n{static_cast<std::int64_t>(nodes_.size())};
+    stack[top++] = {max_level_, (std::int64_t{1} << max_level_) - 1, false};
+    while (top) {
+      Cell cell{stack[--top]};
+      if (cell.level <= 3) {
+        // small subtree, a linear scan is cheaper than descending
+        std::int64_t i0{cell.x >> cell.level << cell.level},
+          i1{std::min(n, i0 + (std::int64_t{1} << (cell.level+1)) - 1)};
+        for (std::int64_t i{i0}; i < i1 && nodes_[i].start < end; ++i) {
+          if (start < nodes_[i].end) {
+            fn(nodes_[i]);
+          }
+        }
+      } else if (!cell.left_done) {
+        // the left child may lie past the end of the array
+        std::int64_t left{cell.x - (std::int64_t{1} << (cell.level-1))};
+        stack[top++] = {cell.level, cell.x, true};
+        if (left >= n || nodes_[left].max_end > start) {
+          stack[top++] = {cell.level-1, left, false};
+        }
+      } else if (cell.x < n && nodes_[cell.x].start < end) {
+        if (start < nodes_[cell.x].end) {
+          fn(nodes_[cell.x]);
+        }
+        stack[top++] = {cell.level-1, cell.x + (std::int64_t{1} << (cell.level-1)), false};
+      }
+    }
+  }
+
+  bool any_overlap(std::int64_t start, std::int64_t end) const {
+    bool found{false};
+    overlapping(start, end, [&found](const Node &) { found = true; });
+    return found;
+  }
+
+  // Length of the union of all intervals, overlaps are only counted once
+  std::int64_t union_seconds() const {
+    std::int64_t total{0}, run_start{0}, run_end{INT64_MIN};
+    for (const auto &node : nodes_) {
+      if (node.start > run_end) {
+        total += run_end > run_start ? run_end - run_start : 0;
+        run_start = node.start;
+        run_end = node.end;
+      } else {
+        run_end = std::max(run_end, node.end);
+      }
+    }
+    return total + (run_end > run_start ? run_end - run_start : 0);
+  }
+
+ private:
+  // Fills max_end bottom-up, O(n)
+  void index() {
+    const auto n{static_cast<std::int64_t>(nodes_.size())};
+    max_level_ = 0;
+    if (!n) {
+      return;
+    }
+    // last_i is the rightmost node of the current level, last its max_end
+    std::int64_t last_i{0}, last{0};
+    for (std::int64_t i{0}; i < n; i += 2) {
+      last_i = i;
+      last = nodes_[i].max_end = nodes_[i].end;
+    }
+    int level{1};
+    for (; (std::int64_t{1} << level) <= n; ++level) {
+      std::int64_t x{std::int64_t{1} << (level-1)}, first{(x << 1) - 1}, step{x << 2};
+      for (std::int64_t i{first}; i < n; i += step) {
+        std::int64_t left{nodes_[i-x].max_end},
+          right{i+x < n ? nodes_[i+x].max_end : last};
+        nodes_[i].max_end = std::max({nodes_[i].end, left, right});
+      }
+      last_i = (last_i >> level & 1) ? last_i - x : last_i + x;
+      if (last_i < n && nodes_[last_i].max_end > last) {
+        last = nodes_[last_i].max_end;
+      }
+    }
+    max_level_ = level-1;
+  }
+
+  std::vector<Node> nodes_;
+  int max_level_{0};
+};
+
+// Calls fn(day, seconds) for every calendar day [start, end) touches
+template <typename Fn>
+void split_by_day(std::int64_t start, std::int64_t end, Fn &&fn) {
+  while (start < end) {
+    std::int64_t day{civil_day(start)};
+    std::int64_t day_end{std::min(end, (day+1)*86400)};
+    fn(day, day_end - start);
+    start = day_end;
+  }
+}
+
+const std::string DAYS_FILE{"mywarrior.days"};
+
+// Worked seconds per day, cumulative, rebuilt once the stamp of the log
+// changed. Host byte order:
+//   char magic[8], uint64 size, int64 mtime_ns, int64 first_day,
+//   uint64 day_count, int64 cumulative[day_count]
+class DayTable {
+ public:
+  static DayTable load_or_rebuild() {
+    DayTable table;
+    TrackStamp current{track_stamp()};
+    if (table.load() && table.stamp_ == current) {
+      return table;
+    }
+    debug_print("Rebuilding", DAYS_FILE);
+    table = DayTable{};
+    std::vector<std::int64_t> daily;
+    auto add = [&](std::int64_t day, std::int64_t secs) {
+      if (daily.empty()) {
+        table.first_day_ = day;
+      } else if (day < table.first_day_) {
+        daily.insert(daily.begin(), static_cast<std::size_t>(table.first_day_ - day), 0);
+        table.first_day_ = day;
+      }
+      auto idx{static_cast<std::size_t>(day - table.first_day_)};
+      if (idx >= daily.size()) {
+        daily.resize(idx+1);
+      }
+      daily[idx] += secs;
+    };
+    // closed segments bring their days along, only the track file, the
+    // late run and segments with dead records are scanned
+    std::vector<std::string> scanned{TRACK_FILE, LATE_FILE};
+    for (const auto &segment : load_manifest()) {
+      if (tombstones().any_in(segment.min_start, segment.max_start)) {
+        scanned.push_back(segment.path());
+        continue;
+      }
+      std::int64_t day{civil_day(segment.min_start)};
+      for (auto secs : segment.daily) {
+        if (secs) {
+          add(day, secs);
+        }
+        day++;
+      }
+    }
+    for (const auto &path : scanned) {
+      LineReader reader{path};
+      for_each_session_in(reader, [&](const Session &session) {
+        if (session.phase == Phase::work) {
+          split_by_day(session.start, session.end, add);
+        }
+      }, FIELD_PHASE);
+    }
+    table.cumulative_.resize(daily.size());
+    std::int64_t sum{0};
+    for (std::size_t i{0}; i < daily.size(); ++i) {
+      table.cumulative_[i] = sum += daily[i];
+    }
+    table.stamp_ = current;
+    table.save();
+    return table;
+  }
+
+  // Keeps a fresh table in sync with appends at the end, earlier sessions
+  // leave it stale for a rebuild
+  static void on_append(const std::vector<Session> &sessions,
+      const TrackStamp &before, const TrackStamp &after) {
+    DayTable table;
+    if (!table.load() || !(table.stamp_ == before)) {
+      return;
+    }
+    for (const auto &session : sessions) {
+      if (session.phase != Phase::work) {
+        continue;
+      }
+      if (!table.cumulative_.empty() && civil_day(session.start) < table.last_day()) {
+        return;
+      }
+      split_by_day(session.start, session.end, [&](std::int64_t day, std::int64_t secs) {
+        if (table.cumulative_.empty()) {
+          table.first_day_ = day;
+        }
+        auto idx{static_cast<std::size_t>(day - table.first_day_)};
+        if (idx >= table.cumulative_.size()) {
+          table.cumulative_.resize(idx+1, table.cumulative_.empty() ? 0 : table.cumulative_.back());
+        }
+        for (std::size_t i{idx}; i < table.cumulative_.size(); ++i) {
+          table.cumulative_[i] += secs;
+        }
+      });
+    }
+    table.stamp_ = after;
+    table.save();
+  }
+
+  bool empty() const { return cumulative_.empty(); }
+  std::int64_t first_day() const { return first_day_; }
+  std::int64_t last_day() const {
+    return first_day_ + static_cast<std::int64_t>(cumulative_.size()) - 1;
+  }
+
+  // Worked seconds on the days [first, last], both inclusive
+  std::int64_t total(std::int64_t first, std::int64_t last) const {
+    if (empty()) {
+      return 0;
+    }
+    first = std::max(first, first_day_);
+    last = std::min(last, last_day());
+    if (first > last) {
+      return 0;
+    }
+    return prefix(last) - prefix(first-1);
+  }
+
+  std::int64_t day_total(std::int64_t day) const { return total(day, day); }
+
+ private:
+  // Cumulative seconds up to and including day
+  std::int64_t prefix(std::int64_t day) const {
+    return day < first_day_ ? 0 : cumulative_[static_cast<std::size_t>(day - first_day_)];
+  }
+
+  bool load() {
+    std::ifstream ifs(DAYS_FILE, std::ios_base::binary);
+    char magic[8];
+    std::uint64_t count;
+    if (!ifs.read(magic, sizeof(magic)) || std::memcmp(magic, DAYS_MAGIC, sizeof(magic))
+        || !ifs.read(reinterpret_cast<char *>(&stamp_.size), sizeof(stamp_.size))
+        || !ifs.read(reinterpret_cast<char *>(&stamp_.mtime_ns), sizeof(stamp_.mtime_ns))
+        || !ifs.read(reinterpret_cast<char *>(&first_day_), sizeof(first_day_))
+        || !ifs.read(reinterpret_cast<char *>(&count), sizeof(count))) {
+      return false;
+    }
+    cumulative_.resize(count);
+    return static_cast<bool>(ifs.read(reinterpret_cast<char *>(cumulative_.data()),
+          static_cast<std::streamsize>(count*sizeof(std::int64_t))));
+  }
+
+  // Written to a temporary file and renamed, readers never see half a table
+  void save() const {
+    const std::string tmp_path{DAYS_FILE + ".tmp"};
+    std::ofstream ofs(tmp_path, std::ios_base::binary | std::ios_base::trunc);
+    std::uint64_t count{cumulative_.size()};
+    ofs.write(DAYS_MAGIC, sizeof(DAYS_MAGIC));
+    ofs.write(reinterpret_cast<const char *>(&stamp_.size), sizeof(stamp_.size));
+    ofs.write(reinterpret_cast<const char *>(&stamp_.mtime_ns), sizeof(stamp_.mtime_ns));
+    ofs.write(reinterpret_cast<const char *>(&first_day_), sizeof(first_day_));
+    ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    ofs.write(reinterpret_cast<const char *>(cumulative_.data()),
+        static_cast<std::streamsize>(count*sizeof(std::int64_t)));
+    ofs.close();
+    // the table is only a cache, failing to write it is not fatal
+    if (!ofs || std::rename(tmp_path.c_str(), DAYS_FILE.c_str()) != 0) {
+      debug_print("Could not write", DAYS_FILE);
+      std::remove(tmp_path.c_str());
+    }
+  }
+
+  static constexpr char DAYS_MAGIC[8]{'M', 'W', 'D', 'A', 'Y', 'S', '1', 0};
+
+  TrackStamp stamp_;
+  std::int64_t first_day_{0};
+  std::vector<std::int64_t> cumulative_;
+};
+
+constexpr std::size_t MINUTES_PER_DAY{1440};
+
+// One bit per minute of a day, padded to whole AVX2 registers
+struct alignas(32) DayBitmap {
+  static constexpr std::size_t WORDS{24};
+  std::uint64_t words[WORDS]{};
+
+  void set_range(std::size_t first, std::size_t last) {
+    for (std::size_t m{first}; m < last; ++m) {
+      words[m/64] |= std::uint64_t{1} << (m%64);
+    }
+  }
+
+  bool test(std::size_t minute) const {
+    return words[minute/64] >> (minute%64) & 1;
+  }
+
+  std::uint64_t count() const { return popcount_words(words, WORDS); }
+
+  // Active minutes per hour, popcount over the (at most two) words an hour spans
+  void hour_counts(std::uint32_t counts[24]) const {
+    for (std::size_t h{0}; h < 24; ++h) {
+      std::size_t first{h*60}, last{h*60 + 59};
+      std::size_t w0{first/64}, w1{last/64};
+      std::uint64_t lo_mask{~std::uint64_t{0} << (first%64)},
+        hi_mask{~std::uint64_t{0} >> (63 - last%64)};
+      if (w0 == w1) {
+        counts[h] += static_cast<std::uint32_t>(__builtin_popcountll(words[w0] & lo_mask & hi_mask));
+      } else {
+        counts[h] += static_cast<std::uint32_t>(__builtin_popcountll(words[w0] & lo_mask)
+          + __builtin_popcountll(words[w1] & hi_mask));
+      }
+    }
+  }
+};
+
+const std::string HEAT_FILE{"mywarrior.heat"};
+
+// Per day minute bitmaps of work in roaring style containers (minutes, runs
+// or raw bits), container i being payload[offsets[i] .. offsets[i+1])
+class ActivityStore {
+ public:
+  enum class Kind : std::uint8_t { array, runs, bitmap };
+
+  static ActivityStore load_or_rebuild() {
+    ActivityStore store;
+    TrackStamp current{track_stamp()};
+    if (store.load() && store.stamp_ == current) {
+      return store;
+    }
+    debug_print("Rebuilding", HEAT_FILE);
+    store = ActivityStore{};
+    std::map<std::int64_t, DayBitmap> dense;
+    for_each_session([&dense](const Session &session) {
+      if (session.phase != Phase::work) {
+        return;
+      }
+      // every minute touched by the session counts as active
+      std::int64_t minute{session.start >= 0 ? session.start/60 : -((-session.start+59)/60)};
+      std::int64_t last{session.end >= 0 ? (session.end+59)/60 : -((-session.end)/60)};
+      while (minute < last) {
+        std::int64_t day{civil_day(minute*60)};
+        std::int64_t day_end{std::min(last, (day+1)*static_cast<std::int64_t>(MINUTES_PER_DAY))};
+        dense[day].set_range(static_cast<std::size_t>(minute - day*1440),
+            static_cast<std::size_t>(day_end - day*1440));
+        minute = day_end;
+      }
+    }, FIELD_PHASE);
+    store.offsets_.push_back(0);
+    for (const auto &[day, bitmap] : dense) {
+      store.add(day, bitmap);
+    }
+    store.stamp_ = current;
+    store.save();
+    return store;
+  }
+
+  std::size_t size() const { return days_.size(); }
+  std::int64_t day(std::size_t i) const { return days_[i]; }
+  Kind kind(std::size_t i) const { return kinds_[i]; }
+
+  void decode(std::size_t i, DayBitmap &out) const {
+    out = DayBitmap{};
+    const std::uint16_t *data{payload_.data() + offsets_[i]};
+    std::size_t len{offsets_[i+1] - offsets_[i]};
+    switch (kinds_[i]) {
+      case Kind::array:
+        for (std::size_t j{0}; j < len; ++j) {
+          out.words[data[j]/64] |= std::uint64_t{1} << (data[j]%64);
+        }
+        break;
+      case Kind::runs:
+        for (std::size_t j{0}; j+1 < len; j += 2) {
+          out.set_range(data[j], data[j] + data[j+1] + 1u);
+        }
+        break;
+      case Kind::bitmap:
+        std::memcpy(out.words, data, len*sizeof(std::uint16_t));
+        break;
+    }
+  }
+
+ private:
+  static constexpr std::size_t BITMAP_UNITS{MINUTES_PER_DAY/16};
+
+  void add(std::int64_t day, const DayBitmap &bitmap) {
+    std::size_t cardinality{static_cast<std::size_t>(bitmap.count())}, runs{0};
+    for (std::size_t m{0}; m < MINUTES_PER_DAY; ++m) {
+      runs += bitmap.test(m) && (m == 0 || !bitmap.test(m-1));
+    }
+    days_.push_back(day);
+    // sizes in uint16 units
+    if (cardinality <= 2*runs && cardinality < BITMAP_UNITS) {
+      kinds_.push_back(Kind::array);
+      for (std::size_t m{0}; m < MINUTES_PER_DAY; ++m) {
+        if (bitmap.test(m)) {
+          payload_.push_back(static_cast<std::uint16_t>(m));
+        }
+      }
+    } else if (2*runs < BITMAP_UNITS) {
+      kinds_.push_back(Kind::runs);
+      for (std::size_t m{0}; m < MINUTES_PER_DAY; ++m) {
+        if (bitmap.test(m) && (m == 0 || !bitmap.test(m-1))) {
+          std::size_t len{0};
+          while (m+len+1 < MINUTES_PER_DAY && bitmap.test(m+len+1)) {
+            len++;
+          }
+          payload_.push_back(static_cast<std::uint16_t>(m));
+          payload_.push_back(static_cast<std::uint16_t>(len));
+        }
+      }
+    } else {
+      kinds_.push_back(Kind::bitmap);
+      auto units{reinterpret_cast<const std::uint16_t *>(bitmap.words)};
+      payload_.insert(payload_.end(), units, units + BITMAP_UNITS);
+    }
+    offsets_.push_back(static_cast<std::uint32_t>(payload_.size()));
+  }
+
+  bool load() {
+    std::ifstream ifs(HEAT_FILE, std::ios_base::binary);
+    char magic[8];
+    std::uint64_t count, payload_size;
+    auto read = [&ifs](void *dst, std::size_t len) {
+      return static_cast<bool>(ifs.read(static_cast<char *>(dst), static_cast<std::streamsize>(len)));
+    };
+    if (!read(magic, sizeof(magic)) || std::memcmp(magic, HEAT_MAGIC, sizeof(magic))
+        || !read(&stamp_.size, sizeof(stamp_.size))
+        || !read(&stamp_.mtime_ns, sizeof(stamp_.mtime_ns))
+        || !read(&count, sizeof(count)) || !read(&payload_size, sizeof(payload_size))) {
+      return false;
+    }
+    days_.resize(count);
+    kinds_.resize(count);
+    offsets_.resize(count+1);
+    payload_.resize(payload_size);
+    return read(days_.data(), count*sizeof(std::int64_t))
+      && read(kinds_.data(), count*sizeof(Kind))
+      && read(offsets_.data(), (count+1)*sizeof(std::uint32_t))
+      && read(payload_.data(), payload_size*sizeof(std::uint16_t));
+  }
+
+  void save() const {
+    const std::string tmp_path{HEAT_FILE + ".tmp"};
+    std::ofstream ofs(tmp_path, std::ios_base::binary | std::ios_base::trunc);
+    std::uint64_t count{days_.size()}, payload_size{payload_.size()};
+    auto write = [&ofs](const void *src, std::size_t len) {
+      ofs.write(static_cast<const char *>(src), static_cast<std::streamsize>(len));
+    };
+    write(HEAT_MAGIC, sizeof(HEAT_MAGIC));
+    write(&stamp_.size, sizeof(stamp_.size));
+    write(&stamp_.mtime_ns, sizeof(stamp_.mtime_ns));
+    write(&count, sizeof(count));
+    write(&payload_size, sizeof(payload_size));
+    write(days_.data(), count*sizeof(std::int64_t));
+    write(kinds_.data(), count*sizeof(Kind));
+    write(offsets_.data(), (count+1)*sizeof(std::uint32_t));
+    write(payload_.data(), payload_size*sizeof(std::uint16_t));
+    ofs.close();
+    // only a cache, like the day table
+    if (!ofs || std::rename(tmp_path.c_str(), HEAT_FILE.c_str()) != 0) {
+      debug_print("Could not write", HEAT_FILE);
+      std::remove(tmp_path.c_str());
+    }
+  }
+
+  static constexpr char HEAT_MAGIC[8]{'M', 'W', 'H', 'E', 'A', 'T', '1', 0};
+
+  TrackStamp stamp_;
+  std::vector<std::int64_t> days_;
+  std::vector<Kind> kinds_;
+  std::vector<std::uint32_t> offsets_;
+  std::vector<std::uint16_t> payload_;
+};
+
+// Monday is 0, the 1970-01-01 was a Thursday
+unsigned weekday_of(std::int64_t day) {
+  return static_cast<unsigned>(((day + 3) % 7 + 7) % 7);
+}
+
+// Columnar format: an 8 byte magic, then independent row groups of
+//   uint32 count, int64 start[count], int32 duration[count],
+//   uint8 phase[count], uint32 project[count], uint32 tag[count]
+// in host byte order
+const char COLUMNAR_MAGIC[8]{'M', 'W', 'C', 'O', 'L', '2', 0, 0};
+constexpr std::size_t COLUMNAR_GROUP{1 << 16};
+
+// Sessions as contiguous columns, the in-memory form the SIMD kernels above
+// work on. Durations are capped to what fits into 32 bits.
+struct SessionTable {
+  std::vector<std::int64_t> start;
+  std::vector<std::int32_t> duration;
+  std::vector<std::uint8_t> phase;
+  std::vector<std::uint32_t> project;
+  std::vector<std::uint32_t> tag;
+
+  // The track file
+  static SessionTable load() {
+    SessionTable table;
+    for_each_session([&table](const Session &session) { table.push_back(session); });
+    return table;
+  }
+
+  // A track file or a file written by export --format=columnar
+  static SessionTable load(const std::string &path) {
+    std::ifstream ifs(path, std::ios_base::binary);
+    char magic[8]{};
+    ifs.read(magic, sizeof(magic));
+    if (!ifs || std::memcmp(magic, COLUMNAR_MAGIC, sizeof(magic))) {
+      SessionTable table;
+      LineReader reader{path};
+      if (!reader.is_open()) {
+        throw std::runtime_error("Could not open " + path);
+      }
+      for_each_session_in(reader, [&table](const Session &session) {
+        table.push_back(session);
+      });
+      return table;
+    }
+    SessionTable table;
+    std::uint32_t count;
+    while (ifs.read(reinterpret_cast<char *>(&count), sizeof(count))) {
+      std::size_t old{table.size()};
+      table.resize(old + count);
+      auto read = [&ifs](void *dst, std::size_t len) {
+        ifs.read(static_cast<char *>(dst), static_cast<std::streamsize>(len));
+      };
+      read(table.start.data() + old, count*sizeof(std::int64_t));
+      read(table.duration.data() + old, count*sizeof(std::int32_t));
+      read(table.phase.data() + old, count*sizeof(std::uint8_t));
+      read(table.project.data() + old, count*sizeof(std::uint32_t));
+      read(table.tag.data() + old, count*sizeof(std::uint32_t));
+      if (!ifs) {
+        throw std::runtime_error("Truncated row group in " + path);
+      }
+    }
+    return table;
+  }
+
+  std::size_t size() const { return start.size(); }
+
+  void push_back(const Session &session) {
+    start.push_back(session.start);
+    duration.push_back(static_cast<std::int32_t>(
+          std::min<std::int64_t>(session.end - session.start, INT32_MAX)));
+    phase.push_back(static_cast<std::uint8_t>(session.phase));
+    project.push_back(session.project);
+    tag.push_back(session.tag);
+  }
+
+  Session at(std::size_t i) const {
+    return Session{start[i], start[i] + duration[i], static_cast<Phase>(phase[i]),
+      project[i], tag[i]};
+  }
+
+  void resize(std::size_t n) {
+    start.resize(n);
+    duration.resize(n);
+    phase.resize(n);
+    project.resize(n);
+    tag.resize(n);
+  }
+
+  void clear() { resize(0); }
+};
+
+// Replaces path with content through a synced temporary file and a rename,
+// readers see either the old or the new file
+void replace_file(const std::string &path, std::string_view content) {
+  const std::string tmp_path{path + ".tmp"};
+  try {
+    OutputBuffer out{tmp_path, std::max<std::size_t>(content.size(), 1)};
+    out.append(content);
+    out.sync();
+  } catch (...) {
+    ::unlink(tmp_path.c_str());
+    throw;
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    ::unlink(tmp_path.c_str());
+    throw std::runtime_error("Could not replace " + path);
+  }
+}
+
+// The start of the last record of the track file, INT64_MIN if there is
+// none or it cannot be read from the tail
+std::int64_t last_track_start() {
+  int fd{::open(TRACK_FILE.c_str(), O_RDONLY)};
+  if (fd < 0) {
+    return INT64_MIN;
+  }
+  struct stat st;
+  std::string tail;
+  if (::fstat(fd, &st) == 0) {
+    tail.resize(static_cast<std::size_t>(std::min<off_t>(st.st_size, 64 << 10)));
+    ssize_t got{::pread(fd, tail.data(), tail.size(), st.st_size - static_cast<off_t>(tail.size()))};
+    tail.resize(got > 0 ? static_cast<std::size_t>(got) : 0);
+  }
+  ::close(fd);
+  std::string_view rest{tail};
+  while (!rest.empty() && (rest.back() == '\n' || rest.back() == '\r')) {
+    rest.remove_suffix(1);
+  }
+  std::size_t nl{rest.rfind('\n')};
+  if (nl == std::string_view::npos && tail.size() < static_cast<std::size_t>(st.st_size)) {
+    return INT64_MIN;
+  }
+  Session session;
+  if (!decode_session(rest.substr(nl == std::string_view::npos ? 0 : nl + 1), session, 0)) {
+    return INT64_MIN;
+  }
+  return session.start;
+}
+
+// Appends sessions sorted by start to the late run with a single write, as
+// a sorted run of their own
+void add_late_arrivals(const std::vector<Session> &sessions) {
+  std::string buf;
+  buf.reserve(sessions.size()*80);
+  for (const auto &session : sessions) {
+    encode_session(session, buf);
+  }
+  OutputBuffer out{LATE_FILE, buf.size(), O_APPEND};
+  out.append(buf);
+  out.flush();
+}
+
+// Appends the tombstones of records, given by start and line, with a
+// single write
+void add_tombstones(const std::vector<std::pair<std::int64_t, std::string>> &records) {
+  std::ostringstream oss;
+  for (const auto &[start, line] : records) {
+    oss << civil_to_iso(start) << ' ' << std::hex << fnv1a(line) << std::dec << '\n';
+  }
+  OutputBuffer out{TOMBSTONE_FILE, oss.str().size(), O_APPEND};
+  out.append(oss.str());
+  out.flush();
+}
+
+// Takes back the tombstones of records written again, the dead copies
+// count as the new ones. The file is small, it is rewritten whole.
+void revive_tombstones(const std::vector<std::string> &lines) {
+  std::unordered_set<std::uint64_t> revived;
+  for (const auto &line : lines) {
+    revived.insert(fnv1a(line));
+  }
+  std::ifstream ifs(TOMBSTONE_FILE);
+  std::string content, line;
+  while (std::getline(ifs, line)) {
+    std::istringstream fields{line};
+    std::string start;
+    std::uint64_t hash;
+    if (fields >> start >> std::hex >> hash && revived.count(hash)) {
+      continue;
+    }
+    content += line;
+    content += '\n';
+  }
+  replace_file(TOMBSTONE_FILE, content);
+}
+
+// Appends all sessions with a single write. Those starting before the end
+// of the track file go to the late run, those matching a dead record revive it.
+void append_sessions(const std::vector<Session> &sessions) {
+  if (sessions.empty()) {
+    return;
+  }
+  std::vector<Session> sorted;
+  const auto *batch{&sessions};
+  auto by_start = [](const Session &a, const Session &b) { return a.start < b.start; };
+  if (!std::is_sorted(sessions.begin(), sessions.end(), by_start)) {
+    sorted = sessions;
+    std::stable_sort(sorted.begin(), sorted.end(), by_start);
+    batch = &sorted;
+  }
+  const std::int64_t last{last_track_start()};
+  const Tombstones &dead{tombstones()};
+  std::string buf, line;
+  buf.reserve(batch->size()*80);
+  std::vector<Session> late;
+  std::vector<std::string> revived;
+  for (const auto &session : *batch) {
+    if (!dead.empty()) {
+      line.clear();
+      encode_session(session, line);
+      line.pop_back();
+      if (dead.contains(session.start, line)) {
+        revived.push_back(std::move(line));
+        continue;
+      }
+    }
+    if (session.start < last) {
+      late.push_back(session);
+    } else {
+      encode_session(session, buf);
+    }
+  }
+  TrackStamp before{track_stamp()};
+  if (!buf.empty()) {
+    OutputBuffer out{TRACK_FILE, buf.size(), O_APPEND};
+    out.append(buf);
+    out.flush();
+  }
+  if (!late.empty()) {
+    add_late_arrivals(late);
+  }
+  if (!revived.empty()) {
+    revive_tombstones(revived);
+  }
+  DayTable::on_append(sessions, before, track_stamp());
+}
+
+void write_out_ndjson(const Session &session) {
+  std::string json_str;
+  encode_session(session, json_str);
+  debug_print(json_str.substr(0, json_str.size()-1));
+  append_sessions({session});
+}
+
+IntervalTree load_interval_tree() {
+  std::vector<Session> sessions;
+  for_each_session([&sessions](const Session &session) {
+    sessions.push_back(session);
+  }, FIELD_PHASE);
+  return IntervalTree{sessions};
+}
+
+struct CycleConfig {
+  std::uint64_t work_seconds{25*60};
+  std::uint64_t short_break_seconds{5*60};
+  std::uint64_t long_break_seconds{15*60};
+  // every n-th pomodoro is followed by a long break
+  std::uint64_t long_break_every{4};
+};
+
+struct PlannedPhase {
+  Phase phase;
+  std::uint64_t seconds;
+};
+
+// work, break, work, ..., work. There is no trailing break, the last work
+// phase simply runs into overtime like a single block always did.
+std::vector<PlannedPhase> build_schedule(std::uint64_t pomodoro_count,
+    const CycleConfig &config) {
+  std::vector<PlannedPhase> schedule;
+  schedule.reserve(pomodoro_count*2);
+  for (std::uint64_t i{1}; i <= pomodoro_count; ++i) {
+    schedule.push_back({Phase::work, config.work_seconds});
+    if (i == pomodoro_count) {
+      break;
+    }
+    if (config.long_break_every && i % config.long_break_every == 0) {
+      schedule.push_back({Phase::long_break, config.long_break_seconds});
+    } else {
+      schedule.push_back({Phase::short_break, config.short_break_seconds});
+    }
+  }
+  return schedule;
+}
+
+enum class TrackState : std::uint8_t { running, overtime, stopped };
+
+void track_main(std::uint64_t pomodoro_count, const CycleConfig &config,
+    std::uint32_t project, std::uint32_t tag) {
+  std::signal(SIGINT, signal_handler);
+  debug_print("Pomodoro count: ", pomodoro_count);
+
+  auto schedule{build_schedule(pomodoro_count, config)};
+  debug_print("Scheduled phases: ", schedule.size());
+  std::cout << "Enter to stop early" << std::endl;
+
+  init_nc();
+
+  int input{1337};
+  uint64_t secs;
+  std::size_t current{0};
+  std::uint64_t worked_seconds{0};
+  TrackState state{TrackState::running};
+  auto phase_start{std::chrono::system_clock::now()};
+  while (state != TrackState::stopped) {
+    const PlannedPhase &planned{schedule[current]};
+    secs = seconds_since(phase_start);
+
+    if (secs >= planned.seconds) {
+      if (current+1 < schedule.size()) {
+        // automatic transition, the next phase starts where this one ended
+        auto phase_end{phase_start + std::chrono::seconds(planned.seconds)};
+        write_out_ndjson(Session{to_civil_seconds(phase_start),
+            to_civil_seconds(phase_end), planned.phase, project, tag});
+        if (planned.phase == Phase::work) {
+          worked_seconds += planned.seconds;
+        }
+        phase_start = phase_end;
+        current++;
+        play_sound();
+        continue;
+      }
+      state = TrackState::overtime;
+    }
+
+    // clear screen
+    nc::clear();
+    std::stringstream first_line;
+    if (state == TrackState::overtime) {
+      first_line << "Time over since " << format_seconds(secs-planned.seconds);
+    } else {
+      first_line << "Time remaining: " << format_seconds(planned.seconds-secs);
+    }
+    nc::mvprintw(0, 0, "%s", first_line.str().c_str());
+    nc::mvprintw(1, 0, "Phase %zu/%zu: %s", current+1, schedule.size(),
+        phase_name(planned.phase));
+    nc::mvprintw(2, 0, "q or enter to stop timer");
+    nc::mvprintw(3, 0, "Debug: Last Input '%d'", input);
+    nc::refresh(); // refresh includes "flush out"
+    nc::napms(500); // sleep
+
+    // equal to getch(), but without macros
+    input = nc::wgetch(nc::stdscr);
+    if (input == '\n' || input == 'q' || sigint_recieved) {
+      state = TrackState::stopped;
+      break;
+    }
+
+    // if time is already up: notify the user every 10 seconds
+    if (state == TrackState::overtime && ((secs-planned.seconds)%10)==0) {
+      play_sound();
+    }
+  }
+
+  nc::endwin();
+
+  auto end{std::chrono::system_clock::now()};
+  const PlannedPhase &last{schedule[current]};
+  if (last.phase == Phase::work) {
+    worked_seconds += std::chrono::duration_cast<std::chrono::seconds>(
+        end-phase_start).count();
+  }
+  std::cout << "Successfully worked for " << worked_seconds << " seconds!"
+    << std::endl;
+
+  write_out_ndjson(Session{to_civil_seconds(phase_start),
+      to_civil_seconds(end), last.phase, project, tag});
+  debug_print("end track");
+}
+
+// Prints every tracked session overlapping [start, end)
+void report_overlapping(std::int64_t start, std::int64_t end) {
+  IntervalTree tree{load_interval_tree()};
+  tree.overlapping(start, end, [](const IntervalTree::Node &node) {
+    std::cout << civil_to_iso(node.start) << " - " << civil_to_iso(node.end)
+      << " " << phase_name(node.phase) << std::endl;
+  });
+}
+
+// Adds seconds to a flat array indexed by label id, growing it for ids
+// written by a newer dictionary
+void add_label_seconds(std::vector<std::int64_t> &totals, std::uint32_t id,
+    std::int64_t seconds) {
+  if (id >= totals.size()) {
+    totals.resize(id+1);
+  }
+  totals[id] += seconds;
+}
+
+void print_label_totals(std::ostream &os, const char *title,
+    const std::vector<std::int64_t> &totals, const Dictionary &dict) {
+  std::vector<std::uint32_t> ids;
+  for (std::uint32_t id{1}; id < totals.size(); ++id) {
+    if (totals[id]) {
+      ids.push_back(id);
+    }
+  }
+  if (ids.empty()) {
+    return;
+  }
+  std::sort(ids.begin(), ids.end(),
+      [&totals](std::uint32_t a, std::uint32_t b) { return totals[a] > totals[b]; });
+  os << title << std::endl;
+  for (auto id : ids) {
+    os << "  " << dict.name(id) << ": " << format_seconds(totals[id]) << std::endl;
+  }
+  if (totals[0]) {
+    os << "  (none): " << format_seconds(totals[0]) << std::endl;
+  }
+}
+
+// Weekday x hour grid of active minutes over the days [first_day, last_day],
+// plus how much of each weekday was ever (OR) and always (AND) active
+void report_heatmap(std::int64_t first_day, std::int64_t last_day) {
+  auto store{ActivityStore::load_or_rebuild()};
+  std::uint32_t grid[7][24]{};
+  DayBitmap ever[7], always[7];
+  bool seen[7]{};
+  std::uint64_t days{0}, active_days[7]{};
+  DayBitmap bitmap;
+  for (std::size_t i{0}; i < store.size(); ++i) {
+    if (store.day(i) < first_day || store.day(i) > last_day) {
+      continue;
+    }
+    store.decode(i, bitmap);
+    unsigned wd{weekday_of(store.day(i))};
+    bitmap.hour_counts(grid[wd]);
+    or_words(ever[wd].words, bitmap.words, DayBitmap::WORDS);
+    if (seen[wd]) {
+      and_words(always[wd].words, bitmap.words, DayBitmap::WORDS);
+    } else {
+      always[wd] = bitmap;
+      seen[wd] = true;
+    }
+    active_days[wd]++;
+    days++;
+  }
+  // a day of that weekday without any activity empties the intersection
+  if (store.size()) {
+    std::int64_t span_first{std::max(first_day, store.day(0))},
+      span_last{std::min(last_day, store.day(store.size()-1))};
+    std::uint64_t calendar_days[7]{};
+    for (std::int64_t day{span_first}; day <= span_last; ++day) {
+      calendar_days[weekday_of(day)]++;
+    }
+    for (unsigned wd{0}; wd < 7; ++wd) {
+      seen[wd] = seen[wd] && active_days[wd] == calendar_days[wd];
+    }
+  }
+
+  std::uint32_t max{1};
+  for (auto &row : grid) {
+    for (auto cell : row) {
+      max = std::max(max, cell);
+    }
+  }
+  const char shades[]{" .:-=+*#%@"};
+  const char *names[]{"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+  std::cout << "    ";
+  for (int h{0}; h < 24; ++h) {
+    std::cout << std::setw(2) << std::setfill('0') << h << ' ';
+  }
+  std::cout << std::setfill(' ') << std::setw(9) << "ever" << std::setw(9)
+    << "always" << std::endl;
+  for (unsigned wd{0}; wd < 7; ++wd) {
+    std::cout << names[wd] << ' ';
+    for (unsigned h{0}; h < 24; ++h) {
+      char shade{shades[grid[wd][h] ? 1 + grid[wd][h]*8/max : 0]};
+      std::cout << shade << shade << ' ';
+    }
+    std::cout << std::setfill(' ') << std::setw(9) << format_seconds(ever[wd].count()*60)
+      << std::setw(9) << format_seconds(seen[wd] ? always[wd].count()*60 : 0) << std::endl;
+  }
+  std::cout << days << " active days, darkest cell " << format_seconds(max*60ULL)
+    << " of work" << std::endl;
+}
+
+// Distribution of the work session lengths starting in [from, to), computed
+// over the columns of a session table
+void report_lengths(const SessionTable &table, std::int64_t from, std::int64_t to) {
+  constexpr std::int32_t WIDTH{5*60};
+  constexpr std::size_t BUCKETS{24};
+  std::vector<std::uint32_t> selected;
+  filter_range(table.start.data(), table.size(), from, to, selected);
+  std::vector<std::int32_t> lengths;
+  lengths.reserve(selected.size());
+  for (auto i : selected) {
+    if (table.phase[i] == static_cast<std::uint8_t>(Phase::work)) {
+      lengths.push_back(table.duration[i]);
+    }
+  }
+  if (lengths.empty()) {
+    std::cout << "No work sessions" << std::endl;
+    return;
+  }
+  std::uint64_t counts[BUCKETS]{};
+  histogram_int32(lengths.data(), lengths.size(), WIDTH, counts, BUCKETS);
+  std::int32_t min{0}, max{0};
+  minmax_int32(lengths.data(), lengths.size(), min, max);
+  std::int64_t total{sum_int32(lengths.data(), lengths.size())};
+
+  std::uint64_t peak{*std::max_element(counts, counts+BUCKETS)};
+  std::cout << "Work session lengths (" << lengths.size() << " sessions, "
+    << format_seconds(total) << " total, min " << format_seconds(min)
+    << ", max " << format_seconds(max) << "):" << std::endl;
+  for (std::size_t b{0}; b < BUCKETS; ++b) {
+    if (!counts[b]) {
+      continue;
+    }
+    std::ostringstream label;
+    if (b+1 == BUCKETS) {
+      label << ">= " << (b*WIDTH)/60 << "m";
+    } else {
+      label << (b*WIDTH)/60 << "-" << ((b+1)*WIDTH)/60 << "m";
+    }
+    std::cout << "  " << std::left << std::setw(9) << std::setfill(' ') << label.str()
+      << std::right << std::setw(8) << counts[b] << " "
+      << std::string(static_cast<std::size_t>(counts[b]*50/peak), '#') << std::endl;
+  }
+}
+
+// Worked time between two days (inclusive), answered from the day table
+void report_range(std::int64_t first_day, std::int64_t last_day) {
+  auto table{DayTable::load_or_rebuild()};
+  if (!table.empty()) {
+    first_day = std::max(first_day, table.first_day());
+  }
+  std::cout << "Worked from " << civil_to_iso(first_day*86400).substr(0, 10)
+    << " to " << civil_to_iso(last_day*86400).substr(0, 10) << ": "
+    << format_seconds(table.total(first_day, last_day)) << std::endl;
+}
+
+std::string day_to_string(std::int64_t day) {
+  return civil_to_iso(day*86400).substr(0, 10);
+}
+
+// Moving total, average and best day over window days, in one pass with a
+// monotonic deque for the best day
+void report_rolling(std::int64_t window, std::int64_t first_day, std::int64_t last_day) {
+  auto table{DayTable::load_or_rebuild()};
+  if (table.empty()) {
+    return;
+  }
+  first_day = std::max(first_day, table.first_day());
+  last_day = std::min(last_day, table.last_day());
+  std::cout << std::left << std::setw(12) << "Day" << std::right << std::setw(10) << "Worked"
+    << std::setw(12) << (std::to_string(window) + "d total") << std::setw(12) << "average"
+    << std::setw(12) << "best" << '\n';
+  std::int64_t sum{0};
+  std::deque<std::pair<std::int64_t, std::int64_t>> best;
+  // the days before first_day only fill the first window
+  std::int64_t begin{first_day - window + 1};
+  for (std::int64_t day{begin}; day <= last_day; ++day) {
+    std::int64_t secs{table.day_total(day)};
+    sum += secs;
+    if (day - window >= begin) {
+      sum -= table.day_total(day - window);
+    }
+    while (!best.empty() && best.back().second <= secs) {
+      best.pop_back();
+    }
+    best.emplace_back(day, secs);
+    if (best.front().first <= day - window) {
+      best.pop_front();
+    }
+    if (day < first_day) {
+      continue;
+    }
+    // days before the first recorded one do not count towards the average
+    std::int64_t days{std::min(window, day - table.first_day() + 1)};
+    std::cout << std::left << std::setw(12) << day_to_string(day) << std::right
+      << std::setw(10) << format_seconds(secs) << std::setw(12) << format_seconds(sum)
+      << std::setw(12) << format_seconds(sum / days)
+      << std::setw(12) << format_seconds(best.front().second) << '\n';
+  }
+  std::cout << std::flush;
+}
+
+// One statistic of the report, fed every session. Partials of the same kind
+// merge, so chunks of the log aggregate independently.
+class Accumulator {
+ public:
+  virtual ~Accumulator() = default;
+  virtual void update(const Session &session) = 0;
+  // other always is of the same type, see empty_clone()
+  virtual void merge(const Accumulator &other) = 0;
+  virtual std::unique_ptr<Accumulator> empty_clone() const = 0;
+  virtual void print(std::ostream &os, const Dictionary &dict) const = 0;
+};
+
+// Implements the boilerplate for an accumulator Derived
+template <typename Derived>
+class AccumulatorBase : public Accumulator {
+ public:
+  void merge(const Accumulator &other) override {
+    static_cast<Derived *>(this)->merge_from(static_cast<const Derived &>(other));
+  }
+
+  std::unique_ptr<Accumulator> empty_clone() const override {
+    return std::make_unique<Derived>();
+  }
+
+  // Keys of the record update() reads besides start and end, see
+  // decode_session. Derived classes that need fewer shadow it.
+  static constexpr unsigned FIELDS{FIELD_ALL};
+};
+
+// Work and break totals, work counted over the union of the sessions
+class SummaryAccumulator final : public AccumulatorBase<SummaryAccumulator> {
+ public:
+  static constexpr unsigned FIELDS{FIELD_PHASE};
+
+  void update(const Session &session) override {
+    auto idx{static_cast<std::size_t>(session.phase)};
+    phase_seconds_[idx] += session.end - session.start;
+    phase_sessions_[idx]++;
+    if (session.phase != Phase::work) {
+      return;
+    }
+    if (session.start > run_.second || session.start < run_.first) {
+      // a gap, or the next sorted run of a partial fed out of order
+      close_run(nullptr, 0);
+      run_ = {session.start, session.end};
+    } else {
+      run_.second = std::max(run_.second, session.end);
+    }
+  }
+
+  void merge_from(const SummaryAccumulator &other) {
+    for (std::size_t i{0}; i < PHASE_COUNT; ++i) {
+      phase_seconds_[i] += other.phase_seconds_[i];
+      phase_sessions_[i] += other.phase_sessions_[i];
+    }
+    // the chunks overlap at their edges only
+    closed_seconds_ += other.closed_seconds_;
+    const Run edges[]{other.first_, other.last_, other.run_};
+    close_run(edges, std::size(edges));
+  }
+
+  void print(std::ostream &os, const Dictionary &) const override {
+    // manually added sessions may overlap, so the total is taken over the union
+    SummaryAccumulator closed{*this};
+    closed.close_run(nullptr, 0);
+    std::int64_t work{closed.closed_seconds_ + length(closed.first_) + length(closed.last_)};
+    std::int64_t double_counted{phase_seconds_[0] - work};
+    std::int64_t break_seconds{
+      phase_seconds_[static_cast<std::size_t>(Phase::short_break)]
+      + phase_seconds_[static_cast<std::size_t>(Phase::long_break)]};
+    os << "Work:  " << format_seconds(work)
+      << " (" << phase_sessions_[0] << " sessions)" << std::endl;
+    os << "Break: " << format_seconds(break_seconds)
+      << " (" << phase_sessions_[1] << " short, " << phase_sessions_[2]
+      << " long)" << std::endl;
+    if (double_counted) {
+      os << "Overlapping work sessions, " << format_seconds(double_counted)
+        << " only counted once" << std::endl;
+    }
+  }
+
+ private:
+  using Run = std::pair<std::int64_t, std::int64_t>;
+  static constexpr Run NO_RUN{INT64_MIN, INT64_MIN};
+
+  static std::int64_t length(const Run &run) { return run.second - run.first; }
+
+  // Unites the current run and n more with the first and last runs, keeping
+  // the earliest and latest and summing up the ones in between
+  void close_run(const Run *more, std::size_t n) {
+    Run runs[6]{first_, last_, run_};
+    std::copy(more, more + n, runs + 3);
+    std::sort(runs, runs + 3 + n);
+    first_ = last_ = run_ = NO_RUN;
+    for (std::size_t i{0}; i < 3 + n; ++i) {
+      if (runs[i].second <= runs[i].first) {
+        continue;
+      }
+      if (runs[i].first <= last_.second) {
+        last_.second = std::max(last_.second, runs[i].second);
+        continue;
+      }
+      if (first_ == NO_RUN) {
+        first_ = last_;
+      } else {
+        closed_seconds_ += length(last_);
+      }
+      last_ = runs[i];
+    }
+  }
+
+  // indexed by Phase
+  std::int64_t phase_seconds_[PHASE_COUNT]{};
+  std::uint64_t phase_sessions_[PHASE_COUNT]{};
+  // the run the sweep is in and the earliest and latest before it, those in
+  // between are summed up, overlaps reaching them go unseen (see fsck)
+  Run run_{NO_RUN}, first_{NO_RUN}, last_{NO_RUN};
+  std::int64_t closed_seconds_{0};
+};
+
+// Work time per project and tag, in flat arrays indexed by label id
+class LabelAccumulator final : public AccumulatorBase<LabelAccumulator> {
+ public:
+  void update(const Session &session) override {
+    if (session.phase == Phase::work) {
+      add_label_seconds(project_seconds_, session.project, session.end - session.start);
+      add_label_seconds(tag_seconds_, session.tag, session.end - session.start);
+    }
+  }
+
+  void merge_from(const LabelAccumulator &other) {
+    for (std::uint32_t id{0}; id < other.project_seconds_.size(); ++id) {
+      add_label_seconds(project_seconds_, id, other.project_seconds_[id]);
+    }
+    for (std::uint32_t id{0}; id < other.tag_seconds_.size(); ++id) {
+      add_label_seconds(tag_seconds_, id, other.tag_seconds_[id]);
+    }
+  }
+
+  void print(std::ostream &os, const Dictionary &dict) const override {
+    print_label_totals(os, "By project:", project_seconds_, dict);
+    print_label_totals(os, "By tag:", tag_seconds_, dict);
+  }
+
+ private:
+  std::vector<std::int64_t> project_seconds_, tag_seconds_;
+};
+
+// Work per calendar day, sessions crossing midnight are split
+class DailyAccumulator final : public AccumulatorBase<DailyAccumulator> {
+ public:
+  static constexpr unsigned FIELDS{FIELD_PHASE};
+
+  void update(const Session &session) override {
+    if (session.phase == Phase::work) {
+      split_by_day(session.start, session.end, [this](std::int64_t day, std::int64_t secs) {
+        days_[day] += secs;
+      });
+    }
+  }
+
+  void merge_from(const DailyAccumulator &other) {
+    for (const auto &[day, secs] : other.days_) {
+      days_[day] += secs;
+    }
+  }
+
+  void print(std::ostream &os, const Dictionary &) const override {
+    os << "Daily:" << std::endl;
+    for (const auto &[day, secs] : days_) {
+      os << "  " << day_to_string(day) << "  " << format_seconds(secs) << std::endl;
+    }
+  }
+
+ private:
+  std::map<std::int64_t, std::int64_t> days_;
+};
+
+// Work per week, weeks start on monday
+class WeeklyAccumulator final : public AccumulatorBase<WeeklyAccumulator> {
+ public:
+  static constexpr unsigned FIELDS{FIELD_PHASE};
+
+  void update(const Session &session) override {
+    if (session.phase == Phase::work) {
+      split_by_day(session.start, session.end, [this](std::int64_t day, std::int64_t secs) {
+        weeks_[day - weekday_of(day)] += secs;
+      });
+    }
+  }
+
+  void merge_from(const WeeklyAccumulator &other) {
+    for (const auto &[monday, secs] : other.weeks_) {
+      weeks_[monday] += secs;
+    }
+  }
+
+  void print(std::ostream &os, const Dictionary &) const override {
+    os << "Weekly:" << std::endl;
+    for (const auto &[monday, secs] : weeks_) {
+      os << "  week of " << day_to_string(monday) << "  " << format_seconds(secs) << std::endl;
+    }
+  }
+
+ private:
+  // keyed by the monday of the week
+  std::map<std::int64_t, std::int64_t> weeks_;
+};
+
+// Longest and latest run of consecutive days with work
+class StreakAccumulator final : public AccumulatorBase<StreakAccumulator> {
+ public:
+  static constexpr unsigned FIELDS{FIELD_PHASE};
+
+  void update(const Session &session) override {
+    if (session.phase == Phase::work && session.end > session.start) {
+      for (std::int64_t day{civil_day(session.start)}; day <= civil_day(session.end-1); ++day) {
+        if (days_.empty() || days_.back() != day) {
+          days_.push_back(day);
+        }
+      }
+    }
+  }
+
+  void merge_from(const StreakAccumulator &other) {
+    days_.insert(days_.end(), other.days_.begin(), other.days_.end());
+  }
+
+  void print(std::ostream &os, const Dictionary &) const override {
+    std::vector<std::int64_t> days{days_};
+    std::sort(days.begin(), days.end());
+    days.erase(std::unique(days.begin(), days.end()), days.end());
+    std::size_t best{0}, run{0};
+    std::int64_t best_end{0};
+    for (std::size_t i{0}; i < days.size(); ++i) {
+      run = (i && days[i] == days[i-1]+1) ? run+1 : 1;
+      if (run > best) {
+        best = run;
+        best_end = days[i];
+      }
+    }
+    os << "Longest streak: " << best << " days";
+    if (best) {
+      os << " (" << day_to_string(best_end - static_cast<std::int64_t>(best) + 1)
+        << " to " << day_to_string(best_end) << ")";
+    }
+    os << std::endl << "Latest streak: " << run << " days";
+    if (run) {
+      os << " (ending " << day_to_string(days.back()) << ")";
+    }
+    os << std::endl;
+  }
+
+ private:
+  std::vector<std::int64_t> days_;
+};
+
+// Count, mean, deviation and extremes of the work session lengths. Uses
+// Welford's update and Chan's formula to merge, so it is exact per chunk.
+class SessionStatsAccumulator final : public AccumulatorBase<SessionStatsAccumulator> {
+ public:
+  static constexpr unsigned FIELDS{FIELD_PHASE};
+
+  void update(const Session &session) override {
+    if (session.phase != Phase::work) {
+      return;
+    }
+    auto length{static_cast<double>(session.end - session.start)};
+    count_++;
+    double delta{length - mean_};
+    mean_ += delta / static_cast<double>(count_);
+    m2_ += delta * (length - mean_);
+    min_ = std::min(min_, session.end - session.start);
+    max_ = std::max(max_, session.end - session.start);
+  }
+
+  void merge_from(const SessionStatsAccumulator &other) {
+    if (!other.count_) {
+      return;
+    }
+    auto n{static_cast<double>(count_ + other.count_)};
+    double delta{other.mean_ - mean_};
+    m2_ += other.m2_ + delta*delta * static_cast<double>(count_)
+      * static_cast<double>(other.count_) / n;
+    mean_ += delta * static_cast<double>(other.count_) / n;
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  void print(std::ostream &os, const Dictionary &) const override {
+    if (!count_) {
+      os << "Session lengths: no sessions" << std::endl;
+      return;
+    }
+    double stddev{count_ > 1 ? std::sqrt(m2_ / static_cast<double>(count_-1)) : 0.0};
+    os << "Session lengths: " << count_ << " sessions, mean "
+      << format_seconds(static_cast<std::int64_t>(mean_)) << ", stddev "
+      << format_seconds(static_cast<std::int64_t>(stddev)) << ", min "
+      << format_seconds(min_) << ", max " << format_seconds(max_) << std::endl;
+  }
+
+ private:
+  std::uint64_t count_{0};
+  double mean_{0}, m2_{0};
+  std::int64_t min_{INT64_MAX}, max_{INT64_MIN};
+};
+
+// Log-bucketed histogram like HdrHistogram: exact below 64, then 32 buckets
+// per power of two. Merging adds the counts.
+class LogHistogram {
+ public:
+  static constexpr std::size_t BUCKETS{64 + 26*32};
+
+  static std::size_t index_of(std::uint64_t value) {
+    if (value < 64) {
+      return static_cast<std::size_t>(value);
+    }
+    value = std::min<std::uint64_t>(value, (std::uint64_t{1} << 32) - 1);
+    auto msb{static_cast<std::size_t>(63 - __builtin_clzll(value))};
+    auto mantissa{static_cast<std::size_t>(value >> (msb - 5))};
+    return 64 + (msb - 6)*32 + (mantissa - 32);
+  }
+
+  // Smallest value landing in bucket idx
+  static std::uint64_t lower_bound(std::size_t idx) {
+    if (idx < 64) {
+      return idx;
+    }
+    std::size_t msb{(idx - 64)/32 + 6}, mantissa{(idx - 64)%32 + 32};
+    return static_cast<std::uint64_t>(mantissa) << (msb - 5);
+  }
+
+  void record(std::int64_t value) {
+    value = std::max<std::int64_t>(value, 0);
+    counts_[index_of(static_cast<std::uint64_t>(value))]++;
+    min_ = total_ ? std::min(min_, value) : value;
+    max_ = total_ ? std::max(max_, value) : value;
+    total_++;
+  }
+
+  void merge(const LogHistogram &other) {
+    for (std::size_t i{0}; i < BUCKETS; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    if (other.total_) {
+      min_ = total_ ? std::min(min_, other.min_) : other.min_;
+      max_ = total_ ? std::max(max_, other.max_) : other.max_;
+    }
+    total_ += other.total_;
+  }
+
+  std::uint64_t count() const { return total_; }
+  std::uint64_t count_at(std::size_t idx) const { return counts_[idx]; }
+
+  // Midpoint of the bucket holding the value of rank ceil(p * count),
+  // clamped to the recorded extremes
+  std::int64_t percentile(double p) const {
+    auto rank{static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(total_)))};
+    rank = std::max<std::uint64_t>(rank, 1);
+    std::uint64_t seen{0};
+    for (std::size_t i{0}; i < BUCKETS; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        std::uint64_t lo{lower_bound(i)},
+          hi{i+1 < BUCKETS ? lower_bound(i+1) : lo+1};
+        auto mid{static_cast<std::int64_t>(lo + (hi - lo - 1)/2)};
+        return std::clamp(mid, min_, max_);
+      }
+    }
+    return 0;
+  }
+
+ private:
+  std::array<std::uint64_t, BUCKETS> counts_{};
+  std::uint64_t total_{0};
+  std::int64_t min_{0}, max_{0};
+};
+
+// Percentiles and distribution of the work session lengths, a histogram per
+// month
+class PercentileAccumulator final : public AccumulatorBase<PercentileAccumulator> {
+ public:
+  static constexpr unsigned FIELDS{FIELD_PHASE};
+
+  void update(const Session &session) override {
+    if (session.phase == Phase::work) {
+      monthly_[month_of(session.start)].record(session.end - session.start);
+    }
+  }
+
+  void merge_from(const PercentileAccumulator &other) {
+    for (const auto &[month, histogram] : other.monthly_) {
+      monthly_[month].merge(histogram);
+    }
+  }
+
+  void print(std::ostream &os, const Dictionary &) const override {
+    LogHistogram all;
+    for (const auto &entry : monthly_) {
+      all.merge(entry.second);
+    }
+    if (!all.count()) {
+      return;
+    }
+    os << "Session length percentiles: p50 " << format_seconds(all.percentile(0.5))
+      << ", p90 " << format_seconds(all.percentile(0.9))
+      << ", p99 " << format_seconds(all.percentile(0.99)) << std::endl;
+
+    // collapse the fine buckets into powers of two of minutes
+    constexpr std::size_t BINS{10};
+    std::uint64_t bins[BINS]{};
+    for (std::size_t i{0}; i < LogHistogram::BUCKETS; ++i) {
+      std::uint64_t minutes{LogHistogram::lower_bound(i)/60};
+      std::size_t bin{minutes ? static_cast<std::size_t>(64 - __builtin_clzll(minutes)) : 0};
+      bins[std::min(bin, BINS-1)] += all.count_at(i);
+    }
+    std::uint64_t peak{*std::max_element(bins, bins+BINS)};
+    for (std::size_t b{0}; b < BINS; ++b) {
+      std::ostringstream label;
+      if (b == 0) {
+        label << "< 1m";
+      } else if (b+1 == BINS) {
+        label << ">= " << (1u << (b-1)) << "m";
+      } else {
+        label << (1u << (b-1)) << "-" << (1u << b) << "m";
+      }
+      os << "  " << std::left << std::setw(9) << std::setfill(' ') << label.str()
+        << std::right << std::setw(8) << bins[b] << " "
+        << std::string(static_cast<std::size_t>(bins[b]*50/peak), '#') << std::endl;
+    }
+
+    // only the most recent months, older ones are in the overall numbers
+    constexpr std::size_t RECENT{12};
+    auto it{monthly_.begin()};
+    std::advance(it, monthly_.size() > RECENT ? monthly_.size() - RECENT : 0);
+    for (; it != monthly_.end(); ++it) {
+      os << "  " << it->first/12 << "-" << std::setw(2) << std::setfill('0')
+        << it->first%12 + 1 << std::setfill(' ') << "  p50 "
+        << format_seconds(it->second.percentile(0.5)) << ", p90 "
+        << format_seconds(it->second.percentile(0.9)) << " ("
+        << it->second.count() << " sessions)" << std::endl;
+    }
+  }
+
+ private:
+  // year*12 + month-1
+  static std::int64_t month_of(std::int64_t civil_seconds) {
+    std::int64_t y;
+    unsigned m, d;
+    civil_from_days(civil_day(civil_seconds), y, m, d);
+    return y*12 + m-1;
+  }
+
+  std::map<std::int64_t, LogHistogram> monthly_;
+};
+
+class LongestSessionAccumulator final : public AccumulatorBase<LongestSessionAccumulator> {
+ public:
+  static constexpr unsigned FIELDS{FIELD_PHASE};
+
+  void update(const Session &session) override {
+    if (session.phase == Phase::work && (!found_
+          || session.end - session.start > longest_.end - longest_.start)) {
+      longest_ = session;
+      found_ = true;
+    }
+  }
+
+  void merge_from(const LongestSessionAccumulator &other) {
+    if (other.found_) {
+      update(other.longest_);
+    }
+  }
+
+  void print(std::ostream &os, const Dictionary &) const override {
+    if (found_) {
+      os << "Longest session: " << format_seconds(longest_.end - longest_.start)
+        << " (" << civil_to_iso(longest_.start) << " - " << civil_to_iso(longest_.end)
+        << ")" << std::endl;
+    }
+  }
+
+ private:
+  Session longest_;
+  bool found_{false};
+};
+
+// First and last tracked activity
+class SpanAccumulator final : public AccumulatorBase<SpanAccumulator> {
+ public:
+  static constexpr unsigned FIELDS{0};
+
+  void update(const Session &session) override {
+    first_ = std::min(first_, session.start);
+    last_ = std::max(last_, session.end);
+  }
+
+  void merge_from(const SpanAccumulator &other) {
+    first_ = std::min(first_, other.first_);
+    last_ = std::max(last_, other.last_);
+  }
+
+  void print(std::ostream &os, const Dictionary &) const override {
+    if (first_ <= last_) {
+      os << "First activity: " << civil_to_iso(first_) << std::endl
+        << "Last activity:  " << civil_to_iso(last_) << std::endl;
+    }
+  }
+
+ private:
+  std::int64_t first_{INT64_MAX}, last_{INT64_MIN};
+};
+
+// Clips a session to [from, to), false if nothing is left
+bool clip_session(Session &session, std::int64_t from, std::int64_t to) {
+  session.start = std::max(session.start, from);
+  session.end = std::min(session.end, to);
+  return session.start < session.end;
+}
+
+// Filters for report --where, e.g.
+//   weekday in (mon..fri) and hour >= 9 and duration > 20m and tag = clientX
+// parsed into a tree and flattened into a postfix program on a bit stack
+enum class FilterField : std::uint8_t { weekday, hour, date, duration, phase, project, tag };
+enum class FilterOp : std::uint8_t { eq, ne, lt, le, gt, ge, in, and_, or_, not_ };
+
+struct FilterNode {
+  FilterOp op{FilterOp::eq};
+  FilterField field{FilterField::weekday};
+  std::int64_t value{0};
+  // inclusive bounds of the items of an in list
+  std::vector<std::pair<std::int64_t, std::int64_t>> ranges;
+  std::unique_ptr<FilterNode> lhs, rhs;
+};
+
+class FilterParser {
+ public:
+  FilterParser(std::string_view query, const Dictionary &dict) : query_{query}, dict_{dict} {
+    advance();
+  }
+
+  std::unique_ptr<FilterNode> parse() {
+    auto node{parse_or()};
+    if (!token_.empty()) {
+      fail("end of query");
+    }
+    return node;
+  }
+
+ private:
+  [[noreturn]] void fail(const std::string &expected) const {
+    throw std::runtime_error("Invalid --where: expected " + expected + " at \""
+        + (token_.empty() ? std::string{"end"} : std::string{token_}) + "\"");
+  }
+
+  void advance() {
+    while (pos_ < query_.size() && std::isspace(static_cast<unsigned char>(query_[pos_]))) {
+      pos_++;
+    }
+    std::size_t begin{pos_};
+    auto word_char = [this](std::size_t i) {
+      char c{query_[i]};
+      return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == ':'
+        || (c == '.' && !(i+1 < query_.size() && query_[i+1] == '.'));
+    };
+    quoted_ = false;
+    if (pos_ >= query_.size()) {
+    } else if (query_[pos_] == '"') {
+      auto close{query_.find('"', pos_+1)};
+      if (close == std::string_view::npos) {
+        throw std::runtime_error("Invalid --where: unterminated string");
+      }
+      token_ = query_.substr(pos_+1, close-pos_-1);
+      quoted_ = true;
+      pos_ = close+1;
+      return;
+    } else if (query_.substr(pos_, 2) == ".." || query_.substr(pos_, 2) == "<="
+        || query_.substr(pos_, 2) == ">=" || query_.substr(pos_, 2) == "!="
+        || query_.substr(pos_, 2) == "==") {
+      pos_ += 2;
+    } else if (std::string_view{"()<>=,"}.find(query_[pos_]) != std::string_view::npos) {
+      pos_++;
+    } else if (word_char(pos_)) {
+      while (pos_ < query_.size() && word_char(pos_)) {
+        pos_++;
+      }
+    } else {
+      throw std::runtime_error("Invalid --where: unexpected \"" + std::string{query_[pos_]} + "\"");
+    }
+    token_ = query_.substr(begin, pos_-begin);
+  }
+
+  bool accept(std::string_view keyword) {
+    if (!quoted_ && token_ == keyword) {
+      advance();
+      return true;
+    }
+    return false;
+  }
+
+  std::unique_ptr<FilterNode> combine(FilterOp op, std::unique_ptr<FilterNode> lhs,
+      std::unique_ptr<FilterNode> rhs) {
+    auto node{std::make_unique<FilterNode>()};
+    node->op = op;
+    node->lhs = std::move(lhs);
+    node->rhs = std::move(rhs);
+    return node;
+  }
+
+  std::unique_ptr<FilterNode> parse_or() {
+    auto node{parse_and()};
+    while (accept("or")) {
+      node = combine(FilterOp::or_, std::move(node), parse_and());
+    }
+    return node;
+  }
+
+  std::unique_ptr<FilterNode> parse_and() {
+    auto node{parse_unary()};
+    while (accept("and")) {
+      node = combine(FilterOp::and_, std::move(node), parse_unary());
+    }
+    return node;
+  }
+
+  std::unique_ptr<FilterNode> parse_unary() {
+    if (accept("not")) {
+      return combine(FilterOp::not_, parse_unary(), nullptr);
+    }
+    if (accept("(")) {
+      auto node{parse_or()};
+      if (!accept(")")) {
+        fail("\")\"");
+      }
+      return node;
+    }
+    return parse_comparison();
+  }
+
+  std::unique_ptr<FilterNode> parse_comparison() {
+    static const std::pair<std::string_view, FilterField> fields[]{
+      {"weekday", FilterField::weekday}, {"hour", FilterField::hour},
+      {"date", FilterField::date}, {"duration", FilterField::duration},
+      {"phase", FilterField::phase}, {"project", FilterField::project},
+      {"tag", FilterField::tag}};
+    static const std::pair<std::string_view, FilterOp> ops[]{
+      {"=", FilterOp::eq}, {"==", FilterOp::eq}, {"!=", FilterOp::ne},
+      {"<", FilterOp::lt}, {"<=", FilterOp::le}, {">", FilterOp::gt},
+      {">=", FilterOp::ge}, {"in", FilterOp::in}};
+    auto node{std::make_unique<FilterNode>()};
+    auto field{std::find_if(std::begin(fields), std::end(fields),
+        [this](const auto &f) { return !quoted_ && f.first == token_; })};
+    if (field == std::end(fields)) {
+      fail("weekday, hour, date, duration, phase, project or tag");
+    }
+    node->field = field->second;
+    advance();
+    auto op{std::find_if(std::begin(ops), std::end(ops),
+        [this](const auto &o) { return !quoted_ && o.first == token_; })};
+    if (op == std::end(ops)) {
+      fail("a comparison");
+    }
+    node->op = op->second;
+    advance();
+    bool ordered{node->field != FilterField::phase && node->field != FilterField::project
+      && node->field != FilterField::tag};
+    if (node->op == FilterOp::in) {
+      if (!accept("(")) {
+        fail("\"(\"");
+      }
+      do {
+        std::int64_t lo{value(node->field)}, hi{lo};
+        if (accept("..")) {
+          if (!ordered) {
+            fail("a single value");
+          }
+          hi = value(node->field);
+        }
+        node->ranges.emplace_back(lo, hi);
+      } while (accept(","));
+      if (!accept(")")) {
+        fail("\")\"");
+      }
+    } else {
+      if (!ordered && node->op != FilterOp::eq && node->op != FilterOp::ne) {
+        fail("= or !=");
+      }
+      node->value = value(node->field);
+    }
+    return node;
+  }
+
+  // Parses the value of field and advances past it
+  std::int64_t value(FilterField field) {
+    std::string token{token_};
+    std::int64_t out{0};
+    bool ok{!token.empty()};
+    switch (field) {
+      case FilterField::weekday: {
+        static const char *names[]{"mon", "tue", "wed", "thu", "fri", "sat", "sun"};
+        auto it{std::find_if(std::begin(names), std::end(names),
+            [&token](const char *name) { return token.size() >= 3 && token.compare(0, 3, name) == 0; })};
+        ok = it != std::end(names);
+        out = it - std::begin(names);
+        break;
+      }
+      case FilterField::hour:
+        ok = ok && token.size() <= 2 && std::all_of(token.begin(), token.end(), ::isdigit);
+        out = ok ? std::stoll(token) : 0;
+        ok = ok && out < 24;
+        break;
+      case FilterField::date:
+        ok = parse_iso(token + "T00:00:00", out);
+        out = civil_day(out);
+        break;
+      case FilterField::duration: {
+        // e.g. 90s, 20m, 1h30m
+        std::size_t i{0};
+        while (ok && i < token.size()) {
+          std::size_t digits{i};
+          std::int64_t amount{0};
+          while (i < token.size() && std::isdigit(static_cast<unsigned char>(token[i]))
+              && i-digits < 9) {
+            amount = amount*10 + (token[i++] - '0');
+          }
+          char unit{i < token.size() ? token[i++] : '\0'};
+          ok = i-1 > digits && (unit == 'h' || unit == 'm' || unit == 's');
+          out += amount * (unit == 'h' ? 3600 : unit == 'm' ? 60 : 1);
+        }
+        break;
+      }
+      case FilterField::phase: {
+        Phase phase;
+        ok = parse_phase(token, phase);
+        out = static_cast<std::int64_t>(phase);
+        break;
+      }
+      case FilterField::project:
+      case FilterField::tag: {
+        // a name never interned can not match anything
+        auto id{dict_.find(token)};
+        out = id ? static_cast<std::int64_t>(id) : -1;
+        break;
+      }
+    }
+    if (!ok) {
+      fail(field == FilterField::weekday ? "a weekday like mon"
+          : field == FilterField::hour ? "an hour 0-23"
+          : field == FilterField::date ? "a date YYYY-mm-dd"
+          : field == FilterField::duration ? "a duration like 20m or 1h30m"
+          : field == FilterField::phase ? "work, short_break or long_break"
+          : "a label");
+    }
+    advance();
+    return out;
+  }
+
+  std::string_view query_;
+  const Dictionary &dict_;
+  std::size_t pos_{0};
+  std::string_view token_;
+  bool quoted_{false};
+};
+
+class FilterProgram {
+ public:
+  static FilterProgram compile(std::string_view query, const Dictionary &dict) {
+    auto root{FilterParser{query, dict}.parse()};
+    FilterProgram program;
+    std::size_t depth{0};
+    program.emit(*root, depth);
+    std::int64_t first_day{INT64_MIN}, last_day{INT64_MAX};
+    narrow_days(*root, first_day, last_day);
+    if (first_day != INT64_MIN) {
+      program.start_from_ = first_day*86400;
+    }
+    if (last_day != INT64_MAX) {
+      program.start_to_ = (last_day+1)*86400;
+    }
+    return program;
+  }
+
+  bool matches(const Session &session) const {
+    std::uint64_t stack{0};
+    for (const auto &ins : ops_) {
+      switch (ins.op) {
+        case FilterOp::and_:
+          stack = (stack >> 1) & (stack | ~std::uint64_t{1});
+          break;
+        case FilterOp::or_:
+          stack = (stack >> 1) | (stack & 1);
+          break;
+        case FilterOp::not_:
+          stack ^= 1;
+          break;
+        default:
+          stack = stack << 1 | test(ins, field_value(ins.field, session));
+      }
+    }
+    return stack & 1;
+  }
+
+  // Keys of the record the program looks at besides start and end
+  unsigned fields() const { return fields_; }
+
+  // Every matching session starts in [start_from(), start_to())
+  std::int64_t start_from() const { return start_from_; }
+  std::int64_t start_to() const { return start_to_; }
+
+ private:
+  struct Instruction {
+    FilterOp op;
+    FilterField field;
+    std::int64_t value;
+    // slice of ranges_ for in
+    std::uint32_t first, count;
+  };
+
+  static std::int64_t field_value(FilterField field, const Session &session) {
+    switch (field) {
+      case FilterField::weekday:
+        return weekday_of(civil_day(session.start));
+      case FilterField::hour:
+        return (session.start - civil_day(session.start)*86400) / 3600;
+      case FilterField::date:
+        return civil_day(session.start);
+      case FilterField::duration:
+        return session.end - session.start;
+      case FilterField::phase:
+        return static_cast<std::int64_t>(session.phase);
+      case FilterField::project:
+        return session.project;
+      case FilterField::tag:
+        return session.tag;
+    }
+    return 0;
+  }
+
+  bool test(const Instruction &ins, std::int64_t value) const {
+    switch (ins.op) {
+      case FilterOp::eq: return value == ins.value;
+      case FilterOp::ne: return value != ins.value;
+      case FilterOp::lt: return value < ins.value;
+      case FilterOp::le: return value <= ins.value;
+      case FilterOp::gt: return value > ins.value;
+      case FilterOp::ge: return value >= ins.value;
+      case FilterOp::in:
+        for (std::uint32_t i{ins.first}; i < ins.first + ins.count; ++i) {
+          if (value >= ranges_[i].first && value <= ranges_[i].second) {
+            return true;
+          }
+        }
+        return false;
+      default:
+        return false;
+    }
+  }
+
+  // Postfix order, depth is the stack height after node
+  void emit(const FilterNode &node, std::size_t &depth) {
+    if (node.lhs) {
+      emit(*node.lhs, depth);
+    }
+    if (node.rhs) {
+      emit(*node.rhs, depth);
+    }
+    Instruction ins{node.op, node.field, node.value,
+      static_cast<std::uint32_t>(ranges_.size()), static_cast<std::uint32_t>(node.ranges.size())};
+    ranges_.insert(ranges_.end(), node.ranges.begin(), node.ranges.end());
+    ops_.push_back(ins);
+    if (node.op != FilterOp::and_ && node.op != FilterOp::or_ && node.op != FilterOp::not_) {
+      fields_ |= node.field == FilterField::phase ? FIELD_PHASE
+        : node.field == FilterField::project ? FIELD_PROJECT
+        : node.field == FilterField::tag ? FIELD_TAG : 0u;
+    }
+    if (node.op == FilterOp::and_ || node.op == FilterOp::or_) {
+      depth--;
+    } else if (node.op != FilterOp::not_ && ++depth > 64) {
+      throw std::runtime_error("Invalid --where: nested too deeply");
+    }
+  }
+
+  // Intersects [first, last] with the days that the conjunction at node
+  // allows sessions to start on
+  static void narrow_days(const FilterNode &node, std::int64_t &first, std::int64_t &last) {
+    if (node.op == FilterOp::and_) {
+      narrow_days(*node.lhs, first, last);
+      narrow_days(*node.rhs, first, last);
+      return;
+    }
+    if (node.field != FilterField::date || node.op == FilterOp::or_
+        || node.op == FilterOp::not_ || node.op == FilterOp::ne) {
+      return;
+    }
+    std::int64_t lo{INT64_MIN}, hi{INT64_MAX};
+    switch (node.op) {
+      case FilterOp::eq: lo = hi = node.value; break;
+      case FilterOp::lt: hi = node.value-1; break;
+      case FilterOp::le: hi = node.value; break;
+      case FilterOp::gt: lo = node.value+1; break;
+      case FilterOp::ge: lo = node.value; break;
+      case FilterOp::in:
+        lo = INT64_MAX;
+        hi = INT64_MIN;
+        for (const auto &range : node.ranges) {
+          lo = std::min(lo, range.first);
+          hi = std::max(hi, range.second);
+        }
+        break;
+      default:
+        break;
+    }
+    first = std::max(first, lo);
+    last = std::min(last, hi);
+  }
+
+  std::vector<Instruction> ops_;
+  std::vector<std::pair<std::int64_t, std::int64_t>> ranges_;
+  std::int64_t start_from_{INT64_MIN}, start_to_{INT64_MAX};
+  unsigned fields_{0};
+};
+
+// Calls body(chunk, reader) for line aligned ranges of the log overlapping
+// [from, to), each on its own thread. Returns the number of chunks.
+std::size_t scan_chunks(std::size_t threads, const std::function<void(std::size_t)> &prepare,
+    const std::function<void(std::size_t, LineReader &)> &body,
+    std::int64_t from = INT64_MIN, std::int64_t to = INT64_MAX) {
+  auto ranges{split_track(std::max<std::size_t>(1, threads), from, to)};
+  std::size_t chunks{ranges.size()};
+  prepare(chunks);
+  std::vector<std::thread> workers;
+  std::vector<std::exception_ptr> errors(chunks);
+  for (std::size_t c{0}; c < chunks; ++c) {
+    workers.emplace_back([&, c] {
+      try {
+        LineReader reader{ranges[c].path, ranges[c].begin, ranges[c].end};
+        body(c, reader);
+      } catch (...) {
+        errors[c] = std::current_exception();
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return chunks;
+}
+
+// Bounded lock-free queue between one producer and one consumer thread.
+// The capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing {
+ public:
+  explicit SpscRing(std::size_t capacity)
+    : slots_(std::size_t{1} << (64 - __builtin_clzll(std::max<std::size_t>(capacity, 2) - 1))),
+      mask_{slots_.size() - 1} {}
+
+  // Moves from value only if there was room
+  bool try_push(T &value) {
+    std::size_t tail{tail_.load(std::memory_order_relaxed)};
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(T &out) {
+    std::size_t head{head_.load(std::memory_order_relaxed)};
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    out = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  std::vector<T> slots_;
+  std::size_t mask_;
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+// Bounded lock-free queue from many producer threads to one consumer, with
+// a sequence number per slot (Vyukov's bounded queue)
+template <typename T>
+class MpscRing {
+ public:
+  explicit MpscRing(std::size_t capacity)
+    : mask_{(std::size_t{1} << (64 - __builtin_clzll(std::max<std::size_t>(capacity, 2) - 1))) - 1},
+      cells_{new Cell[mask_ + 1]} {
+    for (std::size_t i{0}; i <= mask_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Moves from value only if there was room
+  bool try_push(T &value) {
+    std::size_t pos{tail_.load(std::memory_order_relaxed)};
+    while (true) {
+      Cell &cell{cells_[pos & mask_]};
+      std::size_t sequence{cell.sequence.load(std::memory_order_acquire)};
+      if (sequence == pos) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (sequence < pos) {
+        // the slot still holds what the consumer has not taken yet
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Only ever called from the consumer thread
+  bool try_pop(T &out) {
+    Cell &cell{cells_[head_ & mask_]};
+    if (cell.sequence.load(std::memory_order_acquire) != head_ + 1) {
+      return false;
+    }
+    out = std::move(cell.value);
+    cell.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    head_++;
+    return true;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  std::size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(64) std::atomic<std::size_t> tail_{0};
+  alignas(64) std::size_t head_{0};
+};
+
+// Counters of one pipelined scan. A stall is one wait of a stage on a
+// full or empty ring, however long it took.
+struct PipelineStats {
+  std::size_t parsers{0};
+  std::uint64_t bytes{0};
+  std::uint64_t blocks{0};
+  std::uint64_t sessions{0};
+  std::uint64_t batches{0};
+  // read: no free buffer or every parser ring full
+  std::uint64_t read_stalls{0};
+  // parse: waiting for a block, waiting for room at the aggregator
+  std::uint64_t parse_input_stalls{0};
+  std::uint64_t parse_output_stalls{0};
+  // aggregate: waiting for a batch
+  std::uint64_t aggregate_stalls{0};
+  // time spent working rather than waiting, summed over the parsers
+  double read_seconds{0};
+  double parse_seconds{0};
+  double aggregate_seconds{0};
+  double wall_seconds{0};
+
+  void print(std::ostream &os) const {
+    double mib{static_cast<double>(bytes) / (1 << 20)};
+    auto rate = [](double amount, double seconds) { return seconds > 0 ? amount / seconds : 0.0; };
+    os << std::fixed << std::setprecision(2)
+      << "Pipeline: " << parsers << " parsers, " << wall_seconds << " s" << std::endl
+      << "  read:      " << mib << " MiB in " << blocks << " blocks, " << read_seconds
+      << " s busy, " << rate(mib, read_seconds) << " MiB/s, " << read_stalls << " stalls"
+      << std::endl
+      << "  parse:     " << sessions << " sessions, " << parse_seconds << " s busy, "
+      << rate(mib, parse_seconds) << " MiB/s, " << parse_input_stalls << " stalls on input, "
+      << parse_output_stalls << " on output" << std::endl
+      << "  aggregate: " << batches << " batches, " << aggregate_seconds << " s busy, "
+      << rate(static_cast<double>(sessions), aggregate_seconds) / 1e6 << " M sessions/s, "
+      << aggregate_stalls << " stalls" << std::endl;
+    os << std::defaultfloat << std::setprecision(6);
+  }
+};
+
+// Scans in three stages over bounded rings: a block reader, parsers keeping
+// the sessions starting in [from, to) that pass keep, and aggregate here
+void run_pipeline(std::size_t parsers, std::int64_t from, std::int64_t to, unsigned fields,
+    const std::function<bool(const Session &)> &keep,
+    const std::function<void(const std::vector<Session> &)> &aggregate, PipelineStats &stats) {
+  constexpr std::size_t BLOCK{1 << 20}, BUFFERS_PER_PARSER{4}, BATCH{1024};
+  struct Block {
+    std::vector<char> data;
+    std::size_t size{0};
+    // nonzero if data holds a compressed block that inflates to raw_size
+    std::size_t raw_size{0};
+    // of the line at data[0] in files[file]
+    std::size_t file{0};
+    std::uint64_t offset{0};
+  };
+  using Clock = std::chrono::steady_clock;
+  auto seconds_since = [](Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+
+  parsers = std::max<std::size_t>(parsers, 1);
+  stats = PipelineStats{};
+  stats.parsers = parsers;
+  auto wall_start{Clock::now()};
+  std::vector<std::unique_ptr<SpscRing<Block>>> inputs;
+  for (std::size_t p{0}; p < parsers; ++p) {
+    inputs.push_back(std::make_unique<SpscRing<Block>>(BUFFERS_PER_PARSER));
+  }
+  MpscRing<Block> free_blocks{BUFFERS_PER_PARSER * parsers};
+  for (std::size_t b{0}; b < BUFFERS_PER_PARSER * parsers; ++b) {
+    Block block;
+    block.data.resize(BLOCK);
+    free_blocks.try_push(block);
+  }
+  MpscRing<std::vector<Session>> batches{4 * parsers};
+  std::atomic<bool> read_done{false}, abort{false};
+  std::atomic<std::size_t> parsers_done{0};
+  std::vector<std::exception_ptr> errors(parsers + 1);
+  std::vector<PipelineStats> parser_stats(parsers);
+  const auto files{track_files(from, to)};
+
+  std::thread reader{[&] {
+    // a free buffer, false once aborted
+    auto take = [&](Block &block) {
+      if (free_blocks.try_pop(block)) {
+        return true;
+      }
+      stats.read_stalls++;
+      while (!free_blocks.try_pop(block)) {
+        if (abort.load(std::memory_order_relaxed)) {
+          return false;
+        }
+        std::this_thread::yield();
+      }
+      return true;
+    };
+    // to the next parser with room, round robin
+    std::size_t next_parser{0};
+    auto hand_out = [&](Block &block) {
+      stats.blocks++;
+      bool stalled{false};
+      while (!abort.load(std::memory_order_relaxed)) {
+        std::size_t p{0};
+        for (; p < parsers && !inputs[(next_parser + p) % parsers]->try_push(block); ++p) {
+        }
+        if (p < parsers) {
+          next_parser = (next_parser + p + 1) % parsers;
+          break;
+        }
+        if (!stalled) {
+          stats.read_stalls++;
+          stalled = true;
+        }
+        std::this_thread::yield();
+      }
+    };
+    try {
+      for (std::size_t f{0}; f < files.size() && !abort.load(std::memory_order_relaxed); ++f) {
+        int fd{::open(files[f].c_str(), O_RDONLY)};
+        if (fd < 0) {
+          continue;
+        }
+        try {
+          std::vector<SegmentBlock> packed;
+          std::uint64_t offset{0};
+          if (read_segment_index(fd, packed)) {
+            // compressed blocks go out as they are, the parsers inflate them
+            for (const auto &entry : packed) {
+              Block block;
+              if (!take(block)) {
+                break;
+              }
+              auto start{Clock::now()};
+              if (block.data.size() < entry.size) {
+                block.data.resize(entry.size);
+              }
+              pread_exact(fd, block.data.data(), entry.size, entry.offset);
+              block.size = entry.size;
+              block.raw_size = entry.raw_size;
+              block.file = f;
+              block.offset = offset;
+              offset += entry.raw_size;
+              stats.bytes += entry.raw_size;
+              stats.read_seconds += seconds_since(start);
+              hand_out(block);
+            }
+            ::close(fd);
+            continue;
+          }
+          std::string carry;
+          bool eof{false};
+          while (!eof) {
+            Block block;
+            if (!take(block)) {
+              break;
+            }
+            auto start{Clock::now()};
+            // the partial line left over from the last block goes first
+            std::size_t used{carry.size()};
+            if (block.data.size() < used + BLOCK/2) {
+              block.data.resize(used + BLOCK);
+            }
+            std::memcpy(block.data.data(), carry.data(), used);
+            std::size_t last{std::string::npos};
+            while (last == std::string::npos && !eof) {
+              if (used == block.data.size()) {
+                block.data.resize(block.data.size() * 2);
+              }
+              ssize_t n;
+              do {
+                n = ::read(fd, block.data.data() + used, block.data.size() - used);
+              } while (n < 0 && errno == EINTR);
+              if (n < 0) {
+                throw std::runtime_error(std::string{"Read failed: "} + std::strerror(errno));
+              }
+              eof = n == 0;
+              auto nl{static_cast<const char *>(::memrchr(block.data.data() + used, '\n',
+                    static_cast<std::size_t>(n)))};
+              used += static_cast<std::size_t>(n);
+              if (nl) {
+                last = static_cast<std::size_t>(nl - block.data.data());
+              }
+            }
+            // at the end of the file the last line may lack its newline
+            block.size = last == std::string::npos ? used : last + 1;
+            carry.assign(block.data.data() + block.size, used - block.size);
+            block.raw_size = 0;
+            block.file = f;
+            block.offset = offset;
+            offset += block.size;
+            stats.bytes += block.size;
+            stats.read_seconds += seconds_since(start);
+            if (block.size == 0) {
+              free_blocks.try_push(block);
+              continue;
+            }
+            hand_out(block);
+          }
+        } catch (...) {
+          ::close(fd);
+          throw;
+        }
+        ::close(fd);
+      }
+    } catch (...) {
+      errors[parsers] = std::current_exception();
+      abort.store(true);
+    }
+    read_done.store(true, std::memory_order_release);
+  }};
+
+  std::vector<std::thread> workers;
+  for (std::size_t p{0}; p < parsers; ++p) {
+    workers.emplace_back([&, p] {
+      auto &counters{parser_stats[p]};
+      try {
+        StructuralIndex index;
+        std::vector<char> inflated;
+        std::vector<Session> batch;
+        auto flush = [&] {
+          if (batch.empty()) {
+            return;
+          }
+          counters.batches++;
+          if (!batches.try_push(batch)) {
+            counters.parse_output_stalls++;
+            while (!batches.try_push(batch) && !abort.load(std::memory_order_relaxed)) {
+              std::this_thread::yield();
+            }
+          }
+          batch = std::vector<Session>{};
+          batch.reserve(BATCH);
+        };
+        batch.reserve(BATCH);
+        bool stalled{false};
+        while (!abort.load(std::memory_order_relaxed)) {
+          // read before popping, so once done an empty ring stays empty
+          bool done{read_done.load(std::memory_order_acquire)};
+          Block block;
+          if (!inputs[p]->try_pop(block)) {
+            if (done) {
+              break;
+            }
+            if (!stalled) {
+              counters.parse_input_stalls++;
+              stalled = true;
+            }
+            std::this_thread::yield();
+            continue;
+          }
+          stalled = false;
+          auto start{Clock::now()};
+          std::string_view lines{block.data.data(), block.size};
+          if (block.raw_size) {
+            if (inflated.size() < block.raw_size) {
+              inflated.resize(block.raw_size);
+            }
+            inflate_block(block.data.data(), block.size, inflated.data(), block.raw_size);
+            lines = std::string_view{inflated.data(), block.raw_size};
+          }
+          for_each_session_in_block(files[block.file], lines, block.offset, index, from, to,
+              fields, [&](const Session &session) {
+            if (!keep || keep(session)) {
+              counters.sessions++;
+              batch.push_back(session);
+              if (batch.size() == BATCH) {
+                flush();
+              }
+            }
+          });
+          counters.parse_seconds += seconds_since(start);
+          free_blocks.try_push(block);
+        }
+        flush();
+      } catch (...) {
+        errors[p] = std::current_exception();
+        abort.store(true);
+      }
+      parsers_done.fetch_add(1, std::memory_order_release);
+    });
+  }
+
+  try {
+    bool stalled{false};
+    while (!abort.load(std::memory_order_relaxed)) {
+      // every batch was pushed before its parser counted itself done
+      bool done{parsers_done.load(std::memory_order_acquire) == parsers};
+      std::vector<Session> batch;
+      if (batches.try_pop(batch)) {
+        stalled = false;
+        auto start{Clock::now()};
+        aggregate(batch);
+        stats.aggregate_seconds += seconds_since(start);
+      } else if (done) {
+        break;
+      } else {
+        if (!stalled) {
+          stats.aggregate_stalls++;
+          stalled = true;
+        }
+        std::this_thread::yield();
+      }
+    }
+  } catch (...) {
+    errors[parsers] = errors[parsers] ? errors[parsers] : std::current_exception();
+    abort.store(true);
+  }
+  reader.join();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  for (const auto &counters : parser_stats) {
+    stats.sessions += counters.sessions;
+    stats.batches += counters.batches;
+    stats.parse_input_stalls += counters.parse_input_stalls;
+    stats.parse_output_stalls += counters.parse_output_stalls;
+    stats.parse_seconds += counters.parse_seconds;
+  }
+  stats.wall_seconds = seconds_since(wall_start);
+}
+
+// Runtime composed report: accumulators are registered one by one and
+// updated through virtual calls. Sessions are clipped to [from, to) first.
+class ReportEngine {
+ public:
+  ReportEngine(std::int64_t from, std::int64_t to) : from_{from}, to_{to} {}
+
+  void add(std::unique_ptr<Accumulator> accumulator) {
+    accumulators_.push_back(std::move(accumulator));
+  }
+
+  void update(const Session &session) {
+    update(accumulators_, session);
+  }
+
+  void run(std::size_t threads) {
+    std::vector<std::vector<std::unique_ptr<Accumulator>>> partials;
+    scan_chunks(threads, [&](std::size_t chunks) {
+      partials.resize(chunks);
+      for (auto &partial : partials) {
+        for (const auto &accumulator : accumulators_) {
+          partial.push_back(accumulator->empty_clone());
+        }
+      }
+    }, [&](std::size_t c, LineReader &reader) {
+      for_each_session_in(reader, [&](const Session &session) {
+        update(partials[c], session);
+      });
+    }, from_, to_);
+    for (const auto &partial : partials) {
+      for (std::size_t i{0}; i < accumulators_.size(); ++i) {
+        accumulators_[i]->merge(*partial[i]);
+      }
+    }
+  }
+
+  void print(std::ostream &os, const Dictionary &dict) const {
+    for (const auto &accumulator : accumulators_) {
+      accumulator->print(os, dict);
+    }
+  }
+
+ private:
+  void update(std::vector<std::unique_ptr<Accumulator>> &targets, Session session) const {
+    if (!clip_session(session, from_, to_)) {
+      return;
+    }
+    for (auto &accumulator : targets) {
+      accumulator->update(session);
+    }
+  }
+
+  std::int64_t from_, to_;
+  std::vector<std::unique_ptr<Accumulator>> accumulators_;
+};
+
+// Compile time composed report: the accumulators are a tuple, so the per
+// session update inlines instead of looping over virtual calls
+template <typename ...Accs>
+class FusedAggregator {
+ public:
+  FusedAggregator(std::int64_t from, std::int64_t to) : from_{from}, to_{to} {}
+
+  // Only sessions matching filter are aggregated, it has to outlive run()
+  void set_filter(const FilterProgram *filter) { filter_ = filter; }
+
+  void update(Session session) {
+    if ((filter_ && !filter_->matches(session)) || !clip_session(session, from_, to_)) {
+      return;
+    }
+    std::apply([&session](auto &...accs) { (accs.update(session), ...); }, accs_);
+  }
+
+  void merge(const FusedAggregator &other) {
+    merge(other, std::index_sequence_for<Accs...>{});
+  }
+
+  void run(std::size_t threads) {
+    std::vector<FusedAggregator> partials;
+    // sessions starting at or after to_ are clipped away entirely
+    // only the keys some accumulator or the filter looks at are decoded
+    unsigned fields{(Accs::FIELDS | ... | (filter_ ? filter_->fields() : 0u))};
+    std::int64_t start_from{filter_ ? filter_->start_from() : INT64_MIN},
+      start_to{std::min(to_, filter_ ? filter_->start_to() : INT64_MAX)};
+    scan_chunks(threads, [&](std::size_t chunks) {
+      partials.assign(chunks, FusedAggregator{from_, to_});
+      for (auto &partial : partials) {
+        partial.set_filter(filter_);
+      }
+    }, [&](std::size_t c, LineReader &reader) {
+      for_each_session_starting_in(reader, start_from, start_to, [&](const Session &session) {
+        partials[c].update(session);
+      }, fields);
+    }, std::max(from_, start_from), start_to);
+    for (const auto &partial : partials) {
+      merge(partial);
+    }
+  }
+
+  // Like run(), but reading, parsing and aggregating in separate stages
+  void run_pipelined(std::size_t parsers, PipelineStats &stats) {
+    unsigned fields{(Accs::FIELDS | ... | (filter_ ? filter_->fields() : 0u))};
+    std::int64_t start_from{filter_ ? filter_->start_from() : INT64_MIN},
+      start_to{std::min(to_, filter_ ? filter_->start_to() : INT64_MAX)};
+    std::function<bool(const Session &)> keep;
+    if (filter_) {
+      keep = [this](const Session &session) { return filter_->matches(session); };
+    }
+    // the parsers hand over their batches in no particular order, which the
+    // accumulators take as sorted runs fed out of order
+    run_pipeline(parsers, start_from, start_to, fields, keep,
+        [this](const std::vector<Session> &batch) {
+      for (Session session : batch) {
+        if (clip_session(session, from_, to_)) {
+          std::apply([&session](auto &...accs) { (accs.update(session), ...); }, accs_);
+        }
+      }
+    }, stats);
+  }
+
+  void print(std::ostream &os, const Dictionary &dict) const {
+    std::apply([&](const auto &...accs) { (accs.print(os, dict), ...); }, accs_);
+  }
+
+ private:
+  template <std::size_t ...Is>
+  void merge(const FusedAggregator &other, std::index_sequence<Is...>) {
+    (std::get<Is>(accs_).merge_from(std::get<Is>(other.accs_)), ...);
+  }
+
+  std::int64_t from_, to_;
+  const FilterProgram *filter_{nullptr};
+  std::tuple<Accs...> accs_;
+};
+
+template <typename ...Ts>
+struct TypeList {};
+
+// Appends a type, or all types of a TypeList, to a TypeList
+template <typename List, typename Next>
+struct Append;
+
+template <typename ...Ts, typename Next>
+struct Append<TypeList<Ts...>, Next> {
+  using type = TypeList<Ts..., Next>;
+};
+
+template <typename ...Ts, typename ...Us>
+struct Append<TypeList<Ts...>, TypeList<Us...>> {
+  using type = TypeList<Ts..., Us...>;
+};
+
+// Calls fn with a FusedAggregator of Chosen... and those of Rest... whose
+// bit is set in mask, a TypeList in Rest sharing one bit. Keep Rest short.
+template <typename Fn, typename ...Chosen>
+void with_fused(std::uint32_t, std::int64_t from, std::int64_t to, Fn &&fn,
+    TypeList<Chosen...>, TypeList<>) {
+  FusedAggregator<Chosen...> aggregator{from, to};
+  fn(aggregator);
+}
+
+template <typename Fn, typename ...Chosen, typename Next, typename ...Rest>
+void with_fused(std::uint32_t mask, std::int64_t from, std::int64_t to, Fn &&fn,
+    TypeList<Chosen...>, TypeList<Next, Rest...>) {
+  if (mask & 1) {
+    with_fused(mask >> 1, from, to, std::forward<Fn>(fn),
+        typename Append<TypeList<Chosen...>, Next>::type{}, TypeList<Rest...>{});
+  } else {
+    with_fused(mask >> 1, from, to, std::forward<Fn>(fn),
+        TypeList<Chosen...>{}, TypeList<Rest...>{});
+  }
+}
+
+// The k greatest values pushed, by Less, in a min-heap of at most k
+template <typename T, typename Less>
+class TopK {
+ public:
+  explicit TopK(std::size_t k) : k_{k} {}
+
+  void push(const T &value) {
+    if (heap_.size() < k_) {
+      heap_.push_back(value);
+      std::push_heap(heap_.begin(), heap_.end(), Greater{});
+    } else if (k_ && Less{}(heap_.front(), value)) {
+      std::pop_heap(heap_.begin(), heap_.end(), Greater{});
+      heap_.back() = value;
+      std::push_heap(heap_.begin(), heap_.end(), Greater{});
+    }
+  }
+
+  void merge(const TopK &other) {
+    for (const auto &value : other.heap_) {
+      push(value);
+    }
+  }
+
+  // Greatest first
+  std::vector<T> sorted() const {
+    std::vector<T> values{heap_};
+    std::sort_heap(values.begin(), values.end(), Greater{});
+    return values;
+  }
+
+ private:
+  struct Greater {
+    bool operator()(const T &lhs, const T &rhs) const { return Less{}(rhs, lhs); }
+  };
+
+  std::size_t k_;
+  std::vector<T> heap_;
+};
+
+// ties rank the earlier one higher
+struct LongerSession {
+  bool operator()(const Session &lhs, const Session &rhs) const {
+    return std::make_pair(lhs.end - lhs.start, -lhs.start)
+      < std::make_pair(rhs.end - rhs.start, -rhs.start);
+  }
+};
+
+// Work days or streaks of them, [first, last] with a total
+struct DayRange {
+  std::int64_t first{0};
+  std::int64_t last{0};
+  std::int64_t seconds{0};
+};
+
+struct MoreSeconds {
+  bool operator()(const DayRange &lhs, const DayRange &rhs) const {
+    return std::make_pair(lhs.seconds, -lhs.first) < std::make_pair(rhs.seconds, -rhs.first);
+  }
+};
+
+struct LongerStreak {
+  bool operator()(const DayRange &lhs, const DayRange &rhs) const {
+    return std::make_pair(lhs.last - lhs.first, -lhs.first)
+      < std::make_pair(rhs.last - rhs.first, -rhs.first);
+  }
+};
+
+// The k longest work sessions, most productive days and longest streaks,
+// holding only k of each
+void report_top(std::size_t k, std::int64_t from, std::int64_t to,
+    std::int64_t first_day, std::int64_t last_day) {
+  auto dict{Dictionary::load()};
+  std::vector<TopK<Session, LongerSession>> partials;
+  scan_chunks(std::thread::hardware_concurrency(), [&](std::size_t chunks) {
+    partials.assign(chunks, TopK<Session, LongerSession>{k});
+  }, [&](std::size_t c, LineReader &reader) {
+    for_each_session_in(reader, [&](Session session) {
+      if (session.phase == Phase::work && clip_session(session, from, to)) {
+        partials[c].push(session);
+      }
+    }, FIELD_PHASE | FIELD_PROJECT);
+  }, from, to);
+  TopK<Session, LongerSession> sessions{k};
+  for (const auto &partial : partials) {
+    sessions.merge(partial);
+  }
+
+  TopK<DayRange, MoreSeconds> days{k};
+  TopK<DayRange, LongerStreak> streaks{k};
+  auto table{DayTable::load_or_rebuild()};
+  if (!table.empty()) {
+    DayRange streak{0, 0, 0};
+    bool in_streak{false};
+    first_day = std::max(first_day, table.first_day());
+    last_day = std::min(last_day, table.last_day());
+    // one past the end to close a streak running up to last_day
+    for (std::int64_t day{first_day}; day <= last_day+1; ++day) {
+      std::int64_t secs{day <= last_day ? table.day_total(day) : 0};
+      if (secs > 0) {
+        days.push({day, day, secs});
+        if (!in_streak) {
+          streak = {day, day, 0};
+          in_streak = true;
+        }
+        streak.last = day;
+        streak.seconds += secs;
+      } else if (in_streak) {
+        streaks.push(streak);
+        in_streak = false;
+      }
+    }
+  }
+
+  std::size_t rank{0};
+  std::cout << "Longest sessions:" << std::endl;
+  for (const auto &session : sessions.sorted()) {
+    std::cout << "  " << std::setw(2) << ++rank << ". " << std::setw(8)
+      << format_seconds(session.end - session.start) << "  " << civil_to_iso(session.start)
+      << " - " << civil_to_iso(session.end);
+    if (session.project) {
+      std::cout << "  " << dict.name(session.project);
+    }
+    std::cout << std::endl;
+  }
+  rank = 0;
+  std::cout << "Most productive days:" << std::endl;
+  for (const auto &day : days.sorted()) {
+    std::cout << "  " << std::setw(2) << ++rank << ". " << day_to_string(day.first)
+      << "  " << format_seconds(day.seconds) << std::endl;
+  }
+  rank = 0;
+  std::cout << "Longest streaks:" << std::endl;
+  for (const auto &streak : streaks.sorted()) {
+    std::cout << "  " << std::setw(2) << ++rank << ". " << std::setw(4)
+      << streak.last - streak.first + 1 << " days  " << day_to_string(streak.first)
+      << " to " << day_to_string(streak.last) << ", " << format_seconds(streak.seconds)
+      << std::endl;
+  }
+}
+
+struct ReportOptions {
+  bool daily{false};
+  bool weekly{false};
+  bool streaks{false};
+  bool stats{false};
+  bool longest{false};
+  bool span{false};
+  std::int64_t from{INT64_MIN};
+  std::int64_t to{INT64_MAX};
+  std::optional<FilterProgram> where;
+  bool pipeline{false};
+
+  bool any_statistic() const {
+    return daily || weekly || streaks || stats || longest || span;
+  }
+};
+
+void report_main(const ReportOptions &options) {
+  auto dict{Dictionary::load()};
+  // bit order has to match the optional list below
+  std::uint32_t mask{static_cast<std::uint32_t>(options.daily)
+    | static_cast<std::uint32_t>(options.weekly) << 1
+    | static_cast<std::uint32_t>(options.streaks) << 2
+    | static_cast<std::uint32_t>(options.stats) << 3
+    | static_cast<std::uint32_t>(options.longest) << 4
+    | static_cast<std::uint32_t>(options.span) << 5};
+  with_fused(mask, options.from, options.to, [&](auto &aggregator) {
+    aggregator.set_filter(options.where ? &*options.where : nullptr);
+    if (options.pipeline) {
+      // one core each for the reader and the aggregator
+      PipelineStats stats;
+      aggregator.run_pipelined(std::max(3u, std::thread::hardware_concurrency()) - 2, stats);
+      aggregator.print(std::cout, dict);
+      stats.print(std::cerr);
+      return;
+    }
+    aggregator.run(std::thread::hardware_concurrency());
+    aggregator.print(std::cout, dict);
+  }, TypeList<SummaryAccumulator, LabelAccumulator>{},
+  TypeList<DailyAccumulator, WeeklyAccumulator, StreakAccumulator,
+    TypeList<SessionStatsAccumulator, PercentileAccumulator>,
+    LongestSessionAccumulator, SpanAccumulator>{});
+}
+
+std::string get_current_date_string() {
+  auto now = std::chrono::system_clock::now();
+  std::time_t now_c = std::chrono::system_clock::to_time_t(now);
+  std::tm local_tm = *std::localtime(&now_c);
+  std::ostringstream date_stream;
+  date_stream << std::put_time(&local_tm, "%Y-%m-%d");
+  return date_stream.str();
+}
+
+std::string_view trim(std::string_view str) {
+  while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front()))) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back()))) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+// Accepts "YYYY-mm-dd hh:mm[:ss]", with either a space or a T in between
+bool parse_user_datetime(std::string_view str, std::int64_t &out) {
+  str = trim(str);
+  if (str.size() != 16 && str.size() != 19) {
+    return false;
+  }
+  char buf[19];
+  str.copy(buf, str.size());
+  if (buf[10] == ' ') {
+    buf[10] = 'T';
+  }
+  if (str.size() == 16) {
+    buf[16] = ':';
+    buf[17] = buf[18] = '0';
+  }
+  return parse_iso(std::string_view{buf, sizeof(buf)}, out);
+}
+
+// Parses an optional YYYY-mm-dd option into civil seconds at midnight plus
+// offset; leaves out untouched if the option was not given
+bool parse_day_option(const std::optional<std::string> &day,
+    std::int64_t &out, std::int64_t offset) {
+  if (!day) {
+    return true;
+  }
+  if (!parse_user_datetime(*day + " 00:00", out)) {
+    return false;
+  }
+  out += offset;
+  return true;
+}
+
+// start,end[,phase]
+bool parse_csv_row(std::string_view line, Session &out) {
+  auto first{line.find(',')};
+  if (first == std::string_view::npos) {
+    return false;
+  }
+  auto second{line.find(',', first+1)};
+  std::string_view end_field{line.substr(first+1,
+      second == std::string_view::npos ? std::string_view::npos : second-first-1)};
+  out.phase = Phase::work;
+  if (second != std::string_view::npos) {
+    // the label columns after it are read by parse_csv_labels
+    auto third{line.find(',', second+1)};
+    std::string_view phase{line.substr(second+1,
+        third == std::string_view::npos ? std::string_view::npos : third-second-1)};
+    if (!parse_phase(trim(phase), out.phase)) {
+      return false;
+    }
+  }
+  return parse_user_datetime(line.substr(0, first), out.start)
+    && parse_user_datetime(end_field, out.end);
+}
+
+// The project and tag columns after start,end,phase, quoted the way
+// append_csv_field writes them. Missing columns leave the name empty.
+bool parse_csv_labels(std::string_view line, std::string &project, std::string &tag) {
+  project.clear();
+  tag.clear();
+  std::size_t pos{0};
+  for (int column{0}; column < 3; ++column) {
+    pos = line.find(',', pos);
+    if (pos == std::string_view::npos) {
+      return true;
+    }
+    ++pos;
+  }
+  for (std::string *name : {&project, &tag}) {
+    if (pos < line.size() && line[pos] == '"') {
+      // "" inside the quotes is one quote
+      for (++pos;; ++pos) {
+        if (pos >= line.size()) {
+          return false;
+        }
+        if (line[pos] != '"') {
+          name->push_back(line[pos]);
+        } else if (pos+1 < line.size() && line[pos+1] == '"') {
+          name->push_back('"');
+          ++pos;
+        } else {
+          ++pos;
+          break;
+        }
+      }
+    } else {
+      auto comma{std::min(line.find(',', pos), line.size())};
+      name->assign(trim(line.substr(pos, comma-pos)));
+      pos = comma;
+    }
+    if (pos >= line.size()) {
+      return true;
+    }
+    if (line[pos] != ',') {
+      return false;
+    }
+    ++pos;
+  }
+  return true;
+}
+
+struct BatchRow {
+  std::uint64_t line_no;
+  Session session;
+};
+
+struct BatchError {
+  std::uint64_t line_no;
+  std::string reason;
+};
+
+// Every line is either one of our ndjson records or a csv row; both can be
+// mixed in the same input. Line numbers are 1-based indices into lines.
+void validate_batch_chunk(const std::vector<std::string_view> &lines,
+    std::size_t begin, std::size_t end,
+    std::vector<BatchRow> &rows, std::vector<BatchError> &errors) {
+  for (std::size_t i{begin}; i < end; ++i) {
+    std::string_view line{trim(lines[i])};
+    if (line.empty()) {
+      continue;
+    }
+    Session session;
+    bool ok{line.front() == '{' ? decode_session(line, session)
+      : parse_csv_row(line, session)};
+    if (!ok) {
+      // tolerate a csv header
+      if (i == 0 && std::isalpha(static_cast<unsigned char>(line.front()))) {
+        continue;
+      }
+      errors.push_back({i+1, "malformed row"});
+    } else if (session.end <= session.start) {
+      errors.push_back({i+1, "end is not after start"});
+    } else {
+      rows.push_back({i+1, session});
+    }
+  }
+}
+
+std::string read_all(const std::string &path) {
+  std::ostringstream oss;
+  if (path == "-") {
+    oss << std::cin.rdbuf();
+  } else {
+    std::ifstream ifs(path, std::ios_base::binary);
+    if (!ifs) {
+      throw std::runtime_error("Could not open " + path);
+    }
+    oss << ifs.rdbuf();
+  }
+  return oss.str();
+}
+
+// Validates in parallel, rejects overlaps and appends the rest in one write,
+// nonzero labels overriding those of the rows. Returns the number rejected.
+std::size_t add_batch(const std::string &input, std::uint32_t project,
+    std::uint32_t tag) {
+  std::vector<std::string_view> lines;
+  std::string_view rest{input};
+  while (!rest.empty()) {
+    auto nl{rest.find('\n')};
+    lines.push_back(rest.substr(0, nl));
+    rest.remove_prefix(nl == std::string_view::npos ? rest.size() : nl+1);
+  }
+
+  constexpr std::size_t MIN_CHUNK{1 << 14};
+  std::size_t thread_count{std::max<std::size_t>(1, std::min<std::size_t>(
+      std::thread::hardware_concurrency(), lines.size()/MIN_CHUNK))};
+  std::size_t chunk{(lines.size() + thread_count-1) / thread_count};
+  std::vector<std::vector<BatchRow>> chunk_rows(thread_count);
+  std::vector<std::vector<BatchError>> chunk_errors(thread_count);
+  std::vector<std::thread> workers;
+  for (std::size_t t{0}; t < thread_count; ++t) {
+    std::size_t begin{std::min(lines.size(), t*chunk)},
+      end{std::min(lines.size(), (t+1)*chunk)};
+    workers.emplace_back(validate_batch_chunk, std::cref(lines), begin, end,
+        std::ref(chunk_rows[t]), std::ref(chunk_errors[t]));
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  debug_print("Validated", lines.size(), "lines with", thread_count, "threads");
+
+  std::vector<BatchRow> rows;
+  std::vector<BatchError> errors;
+  for (std::size_t t{0}; t < thread_count; ++t) {
+    rows.insert(rows.end(), chunk_rows[t].begin(), chunk_rows[t].end());
+    errors.insert(errors.end(), chunk_errors[t].begin(), chunk_errors[t].end());
+  }
+
+  std::vector<Session> existing;
+  for_each_session([&existing](const Session &session) {
+    existing.push_back(session);
+  }, FIELD_PHASE);
+  IntervalTree index{std::move(existing)};
+
+  std::sort(rows.begin(), rows.end(), [](const BatchRow &a, const BatchRow &b) {
+    return a.session.start < b.session.start;
+  });
+  std::vector<Session> accepted;
+  accepted.reserve(rows.size());
+  const BatchRow *latest{nullptr}; // accepted row reaching furthest
+  for (const auto &row : rows) {
+    if (index.any_overlap(row.session.start, row.session.end)) {
+      errors.push_back({row.line_no, "overlaps an already tracked session"});
+    } else if (latest && latest->session.end > row.session.start) {
+      errors.push_back({row.line_no,
+          "overlaps line " + std::to_string(latest->line_no)});
+    } else {
+      accepted.push_back(row.session);
+      accepted.back().project = project ? project : row.session.project;
+      accepted.back().tag = tag ? tag : row.session.tag;
+      if (!latest || row.session.end > latest->session.end) {
+        latest = &row;
+      }
+    }
+  }
+
+  std::sort(errors.begin(), errors.end(),
+      [](const BatchError &a, const BatchError &b) { return a.line_no < b.line_no; });
+  for (const auto &error : errors) {
+    std::cerr << "line " << error.line_no << ": " << error.reason << std::endl;
+  }
+  append_sessions(accepted);
+  std::cout << "Added " << accepted.size() << " sessions, rejected "
+    << errors.size() << std::endl;
+  return errors.size();
+}
+
+// Reads one answer, the dialog ends without one
+std::string ask(const std::string &question) {
+  std::cout << question;
+  std::string answer;
+  if (!std::getline(std::cin, answer)) {
+    throw std::runtime_error("No answer, nothing added");
+  }
+  return answer;
+}
+
+// Asks again until the answer is a day
+std::string ask_date(const std::string &question) {
+  for (;;) {
+    std::string date{trim(ask(question))};
+    std::int64_t civil;
+    if (parse_user_datetime(date + " 00:00", civil)) {
+      return date;
+    }
+    std::cout << "Expected YYYY-mm-dd" << std::endl;
+  }
+}
+
+// Asks again until the answer is a time of day, returns it on date
+std::int64_t ask_time(const std::string &question, const std::string &date) {
+  for (;;) {
+    std::int64_t civil;
+    if (parse_user_datetime(date + " " + std::string{trim(ask(question))}, civil)) {
+      return civil;
+    }
+    std::cout << "Expected hh:mm" << std::endl;
+  }
+}
+
+// Asks for the session, then adds it like add --start --end. Returns the
+// number of rejected sessions.
+std::size_t add_main(std::uint32_t project, std::uint32_t tag) {
+  // was it today
+  std::string buf;
+  std::cout << "Was it today? (y/n)" << std::endl;
+  std::getline(std::cin, buf); // used to get rid of newline
+  bool was_it_today;
+  char answer = std::tolower(buf[0]);
+  if (answer == 'y') {
+    was_it_today = true;
+  } else if (answer == 'n') {
+    was_it_today = false;
+  } else {
+    was_it_today = true;
+    std::cout << "Not understood... I am assuming it was today" << std::endl;
+  }
+
+  std::string start_date, end_date;
+
+  // get start and end date
+  if (!was_it_today) {
+    start_date = ask_date("Enter start date (YYYY-mm-dd): ");
+    end_date = ask_date("Enter end date (YYYY-mm-dd): ");
+  } else {
+    // Automatically set today's date
+    start_date = end_date = get_current_date_string();
+  }
+  debug_print("Start Date ", start_date);
+  debug_print("End Date ", end_date);
+
+  // get start and end time
+  std::int64_t start{ask_time("Enter start time (hh:mm): ", start_date)};
+  std::int64_t end{ask_time("Enter end time (hh:mm): ", end_date)};
+  return add_batch(civil_to_iso(start) + "," + civil_to_iso(end), project, tag);
+}
+
+// Converts seconds since the unix epoch (UTC) into local civil seconds
+std::int64_t utc_to_civil(std::int64_t unix_seconds) {
+  return to_civil_seconds(std::chrono::system_clock::from_time_t(
+      static_cast<std::time_t>(unix_seconds)));
+}
+
+// iCalendar/timewarrior "YYYYmmddTHHMMSS[Z]". With Z the value is UTC,
+// otherwise it already is local wall clock time.
+bool parse_basic_datetime(std::string_view str, std::int64_t &out) {
+  if (str.size() != 15 && !(str.size() == 16 && str[15] == 'Z')) {
+    return false;
+  }
+  char iso[19];
+  const char layout[]{"....-..-..T..:..:.."};
+  std::size_t src{0};
+  for (std::size_t i{0}; i < sizeof(iso); ++i) {
+    if (layout[i] == '.') {
+      iso[i] = str[src++];
+    } else {
+      iso[i] = layout[i];
+      src += layout[i] == 'T';
+    }
+  }
+  if (str[8] != 'T' || !parse_iso(std::string_view{iso, sizeof(iso)}, out)) {
+    return false;
+  }
+  if (str.size() == 16) {
+    out = utc_to_civil(out);
+  }
+  return true;
+}
+
+struct SessionKeyHash {
+  std::size_t operator()(const std::pair<std::int64_t, std::int64_t> &key) const {
+    std::uint64_t h{static_cast<std::uint64_t>(key.first) * 0x9E3779B97F4A7C15ULL};
+    return static_cast<std::size_t>(h ^ (static_cast<std::uint64_t>(key.second) + (h >> 29)));
+  }
+};
+
+enum class ImportFormat { timew, csv, ics };
+
+// Collects sessions and appends them in large groups
+class BatchedWriter {
+ public:
+  explicit BatchedWriter(std::size_t batch_size = 1 << 16)
+    : batch_size_{batch_size} {
+    pending_.reserve(batch_size);
+  }
+
+  void push(const Session &session) {
+    pending_.push_back(session);
+    if (pending_.size() >= batch_size_) {
+      flush();
+    }
+  }
+
+  void flush() {
+    append_sessions(pending_);
+    written_ += pending_.size();
+    pending_.clear();
+  }
+
+  std::uint64_t written() const { return written_; }
+
+ private:
+  std::vector<Session> pending_;
+  std::size_t batch_size_;
+  std::uint64_t written_{0};
+};
+
+// The first tag of a timewarrior line, from the text after its #. Tags
+// are separated by spaces and quoted when they hold one; empty if none.
+std::string first_timew_tag(std::string_view tags) {
+  tags = trim(tags);
+  std::string tag;
+  if (tags.empty() || tags.front() == '#') {
+    return tag;
+  }
+  if (tags.front() != '"') {
+    return std::string{tags.substr(0, tags.find(' '))};
+  }
+  for (std::size_t i{1}; i < tags.size() && tags[i] != '"'; ++i) {
+    if (tags[i] == '\\' && i+1 < tags.size()) {
+      ++i;
+    }
+    tag.push_back(tags[i]);
+  }
+  return tag;
+}
+
+// Streams the source, dropping and counting duplicates and overlaps like
+// add rejects them
+void import_main(ImportFormat format, const std::string &path) {
+  std::unordered_set<std::pair<std::int64_t, std::int64_t>, SessionKeyHash> seen;
+  std::vector<Session> existing;
+  for_each_session([&](const Session &session) {
+    seen.emplace(session.start, session.end);
+    existing.push_back(session);
+  }, 0);
+  IntervalTree index{std::move(existing)};
+  // imported so far, by start; they never overlap each other
+  std::map<std::int64_t, std::int64_t> imported;
+  auto overlaps_imported = [&imported](const Session &session) {
+    auto next{imported.lower_bound(session.start)};
+    if (next != imported.end() && next->first < session.end) {
+      return true;
+    }
+    return next != imported.begin() && std::prev(next)->second > session.start;
+  };
+
+  LineReader reader{path};
+  if (!reader.is_open()) {
+    throw std::runtime_error("Could not open " + path);
+  }
+  BatchedWriter writer;
+  std::uint64_t line_no{0}, duplicates{0}, overlapping{0}, unparsable{0};
+  // csv label columns and timew tags of the line, interned like the labels
+  // of add once the session is taken
+  auto dict{Dictionary::load()};
+  std::string project, tag;
+  auto emit = [&](Session session) {
+    if (session.end <= session.start) {
+      unparsable++;
+    } else if (!seen.emplace(session.start, session.end).second) {
+      duplicates++;
+    } else if (index.any_overlap(session.start, session.end) || overlaps_imported(session)) {
+      overlapping++;
+    } else {
+      imported.emplace(session.start, session.end);
+      session.project = project.empty() ? 0 : dict.intern(project);
+      session.tag = tag.empty() ? 0 : dict.intern(tag);
+      writer.push(session);
+    }
+  };
+
+  // ics state, a VEVENT spans multiple lines
+  bool in_event{false}, has_start{false}, has_end{false};
+  Session event;
+
+  std::string_view line;
+  while (reader.next(line)) {
+    line_no++;
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    Session session;
+    project.clear();
+    tag.clear();
+    switch (format) {
+      case ImportFormat::timew: {
+        // inc 20240101T090000Z - 20240101T100000Z # tags
+        if (line.substr(0, 4) != "inc ") {
+          break;
+        }
+        auto sep{line.find(" - ")};
+        if (sep == std::string_view::npos) {
+          break; // still running, nothing to import yet
+        }
+        std::string_view start{trim(line.substr(4, sep-4))},
+          end{line.substr(sep+3)};
+        auto hash{end.find('#')};
+        // only the first tag is kept, as the tag of the session
+        tag = hash == std::string_view::npos ? "" : first_timew_tag(end.substr(hash+1));
+        end = trim(end.substr(0, hash));
+        if (parse_basic_datetime(start, session.start)
+            && parse_basic_datetime(end, session.end)) {
+          emit(session);
+        } else {
+          unparsable++;
+        }
+        break;
+      }
+      case ImportFormat::csv:
+        if (parse_csv_row(line, session) && parse_csv_labels(line, project, tag)) {
+          emit(session);
+        } else if (!(line_no == 1 && !line.empty()
+              && std::isalpha(static_cast<unsigned char>(line.front())))) {
+          unparsable += !trim(line).empty();
+        }
+        break;
+      case ImportFormat::ics: {
+        if (line == "BEGIN:VEVENT") {
+          in_event = true;
+          has_start = has_end = false;
+          event = Session{};
+          break;
+        }
+        if (!in_event) {
+          break;
+        }
+        if (line == "END:VEVENT") {
+          in_event = false;
+          if (has_start && has_end) {
+            emit(event);
+          } else {
+            unparsable++;
+          }
+          break;
+        }
+        // DTSTART;TZID=...:value, a TZID is taken to be the local zone
+        auto colon{line.find(':')};
+        std::string_view name{line.substr(0, std::min(colon, line.find(';')))};
+        if (colon == std::string_view::npos) {
+          break;
+        }
+        if (name == "DTSTART") {
+          has_start = parse_basic_datetime(line.substr(colon+1), event.start);
+        } else if (name == "DTEND") {
+          has_end = parse_basic_datetime(line.substr(colon+1), event.end);
+        }
+        break;
+      }
+    }
+  }
+  writer.flush();
+
+  std::cout << "Imported " << writer.written() << " sessions, skipped "
+    << duplicates << " duplicates, " << overlapping << " overlapping and "
+    << unparsable << " unparsable entries" << std::endl;
+}
+
+enum class ExportFormat { csv, ics, ndjson, columnar };
+
+void append_csv_field(OutputBuffer &out, std::string_view field) {
+  if (field.find_first_of(",\"") == std::string_view::npos) {
+    out.append(field);
+    return;
+  }
+  out.append("\"");
+  for (char c : field) {
+    out.append(c == '"' ? std::string_view{"\"\""} : std::string_view{&c, 1});
+  }
+  out.append("\"");
+}
+
+// RFC 5545 TEXT escaping
+void append_ics_text(OutputBuffer &out, std::string_view text) {
+  for (char c : text) {
+    if (c == ',' || c == ';' || c == '\\') {
+      out.append("\\");
+    }
+    out.append(std::string_view{&c, 1});
+  }
+}
+
+// Writes table as one columnar row group and empties it
+void write_columnar_group(OutputBuffer &out, SessionTable &table) {
+  auto count{static_cast<std::uint32_t>(table.size())};
+  if (!count) {
+    return;
+  }
+  auto put = [&out](const void *data, std::size_t len) {
+    std::memcpy(out.claim(len), data, len);
+    out.commit(len);
+  };
+  put(&count, sizeof(count));
+  put(table.start.data(), count*sizeof(std::int64_t));
+  put(table.duration.data(), count*sizeof(std::int32_t));
+  put(table.phase.data(), count*sizeof(std::uint8_t));
+  put(table.project.data(), count*sizeof(std::uint32_t));
+  put(table.tag.data(), count*sizeof(std::uint32_t));
+  table.clear();
+}
+
+// Streams the sessions starting in [from, to) in start order, as a report
+// counts them
+void export_main(ExportFormat format, const std::string &path,
+    std::int64_t from, std::int64_t to) {
+  OutputBuffer out{path};
+  SessionTable group;
+  auto dict{Dictionary::load()};
+  bool filtered{from != INT64_MIN || to != INT64_MAX};
+
+  switch (format) {
+    case ExportFormat::csv:
+      out.append("start,end,phase,project,tag\n");
+      break;
+    case ExportFormat::ics:
+      out.append("BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//mywarrior//EN\r\n");
+      break;
+    case ExportFormat::columnar:
+      out.append(std::string_view{COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)});
+      break;
+    case ExportFormat::ndjson:
+      break;
+  }
+
+  // "YYYYmmddTHHMMSS", floating local time
+  auto append_basic = [&out](std::int64_t civil_seconds) {
+    char iso[19];
+    format_iso(civil_seconds, iso);
+    char *dst{out.claim(15)};
+    for (char c : std::string_view{iso, sizeof(iso)}) {
+      if (c != '-' && c != ':') {
+        *dst++ = c;
+      }
+    }
+    out.commit(15);
+  };
+
+  struct stat st;
+  if (format == ExportFormat::ndjson && !filtered && tombstones().empty()
+      && (::stat(LATE_FILE.c_str(), &st) != 0 || st.st_size == 0)) {
+    // without late arrivals the files are in order already, and without
+    // dead records the lines that pass the checks are copied as they are
+    for (const auto &file : track_files()) {
+      LineReader reader{file};
+      for_each_session_in(reader, [&](const Session &, std::string_view line) {
+        out.append(line);
+        out.append("\n");
+      }, 0);
+    }
+  } else {
+    for_each_record_in_order(from, to, FIELD_ALL,
+        [&](const Session &session, std::string_view line) {
+      switch (format) {
+        case ExportFormat::ndjson:
+          out.append(line);
+          out.append("\n");
+          break;
+        case ExportFormat::csv:
+          out.append_iso(session.start);
+          out.append(",");
+          out.append_iso(session.end);
+          out.append(",");
+          out.append(phase_name(session.phase));
+          out.append(",");
+          append_csv_field(out, session.project ? dict.name(session.project) : "");
+          out.append(",");
+          append_csv_field(out, session.tag ? dict.name(session.tag) : "");
+          out.append("\n");
+          break;
+        case ExportFormat::ics:
+          out.append("BEGIN:VEVENT\r\nUID:");
+          append_basic(session.start);
+          out.append("-");
+          append_basic(session.end);
+          out.append("@mywarrior\r\nDTSTAMP:");
+          append_basic(session.start);
+          out.append("\r\nDTSTART:");
+          append_basic(session.start);
+          out.append("\r\nDTEND:");
+          append_basic(session.end);
+          out.append("\r\nSUMMARY:");
+          if (session.project) {
+            append_ics_text(out, dict.name(session.project));
+          } else {
+            out.append(phase_name(session.phase));
+          }
+          if (session.tag) {
+            out.append("\r\nCATEGORIES:");
+            append_ics_text(out, dict.name(session.tag));
+          }
+          out.append("\r\nEND:VEVENT\r\n");
+          break;
+        case ExportFormat::columnar:
+          group.push_back(session);
+          if (group.size() == COLUMNAR_GROUP) {
+            write_columnar_group(out, group);
+          }
+          break;
+      }
+    });
+  }
+
+  if (format == ExportFormat::columnar) {
+    write_columnar_group(out, group);
+  } else if (format == ExportFormat::ics) {
+    out.append("END:VCALENDAR\r\n");
+  }
+  out.flush();
+}
+
+// Moves the start of a record in place so unknown keys survive, updating a
+// checksum. False if the start is not where we write it.
+bool splice_start(std::string &line, std::int64_t start) {
+  constexpr std::string_view KEY{"\"start\":\""};
+  bool checked{check_record_crc(line) == RecordCheck::ok};
+  if (checked) {
+    line.resize(line.size() - CRC_SUFFIX);
+  }
+  std::size_t pos{line.find(KEY)};
+  std::int64_t old;
+  if (pos == std::string::npos || pos + KEY.size() + 20 > line.size()
+      || line[pos + KEY.size() + 19] != '"'
+      || !parse_iso(std::string_view{line}.substr(pos + KEY.size(), 19), old)) {
+    return false;
+  }
+  format_iso(start, line.data() + pos + KEY.size());
+  if (checked) {
+    append_record_crc(line, 0);
+    line += '}';
+  }
+  return true;
+}
+
+struct FsckRecord {
+  std::int64_t start;
+  std::int64_t end;
+  std::uint64_t offset;
+  std::uint32_t length;
+  Phase phase;
+  std::uint32_t project;
+  std::uint32_t tag;
+  // index into the files of the log
+  std::uint32_t file;
+  // deleted or replaced, see Tombstones; it cannot overlap anything
+  bool dead;
+};
+
+// Closed segments only have to still match what the manifest recorded.
+// Returns the number of segments that do not.
+std::uint64_t fsck_segments() {
+  auto segments{load_manifest()};
+  std::uint64_t errors{0};
+  for (const auto &segment : segments) {
+    std::string content;
+    try {
+      content = read_all(segment.path());
+    } catch (const std::exception &) {
+      errors++;
+      std::cout << segment.path() << ": error: missing" << std::endl;
+      continue;
+    }
+    if (content.size() != segment.bytes || fnv1a(content) != segment.checksum) {
+      errors++;
+      std::cout << segment.path() << ": error: does not match " << MANIFEST_FILE << std::endl;
+    }
+  }
+  if (!segments.empty()) {
+    std::cout << segments.size() << " segments, " << errors << " errors" << std::endl;
+  }
+  return errors;
+}
+
+// Checks the files of the log, overlaps across them and the segments against
+// the manifest, repair merges the late run into the track file. Returns the errors.
+std::uint64_t fsck_main(bool repair) {
+  std::uint64_t segment_errors{fsck_segments()};
+  std::vector<std::string> files;
+  for (auto &run : log_runs()) {
+    files.insert(files.end(), run.begin(), run.end());
+  }
+  // only the track file and the late run are rewritten by a repair
+  auto repairable = [&files](std::uint32_t file) {
+    return files[file] == TRACK_FILE || files[file] == LATE_FILE;
+  };
+  std::vector<FsckRecord> records;
+  std::uint64_t errors{0}, warnings{0}, skipped{0};
+  auto problem = [&files](std::uint32_t file, std::uint64_t offset, const char *kind,
+      const std::string &what) {
+    std::cout << (files[file] == TRACK_FILE ? "" : files[file] + " ") << "offset " << offset
+      << ": " << kind << ": " << what << std::endl;
+  };
+  auto error = [&](std::uint32_t file, std::uint64_t offset, const std::string &what) {
+    errors++;
+    problem(file, offset, "error", what);
+  };
+  auto warning = [&](std::uint32_t file, std::uint64_t offset, const std::string &what) {
+    warnings++;
+    problem(file, offset, "warning", what);
+  };
+
+  auto dict{Dictionary::load()};
+  const std::int64_t tomorrow{to_civil_seconds(std::chrono::system_clock::now()) + 86400};
+  bool monotonic{true};
+  std::string_view line;
+  Session session;
+  for (std::uint32_t file{0}; file < files.size(); ++file) {
+    LineReader reader{files[file]};
+    if (!reader.is_open()) {
+      continue;
+    }
+    // every file is a sorted run on its own, the late run one per batch
+    const bool runs_of_batches{files[file] == LATE_FILE};
+    std::int64_t prev_start{INT64_MIN};
+    while (reader.next(line)) {
+      if (trim(line).empty()) {
+        continue;
+      }
+      if (check_record_crc(line) == RecordCheck::corrupt) {
+        error(file, reader.offset(), "checksum mismatch");
+        skipped++;
+        continue;
+      }
+      if (!decode_session(line, session)) {
+        // only now pay for a full parse, to tell broken json from a bad record
+        error(file, reader.offset(), nlohmann::json::accept(line)
+            ? "record without valid start/end/phase" : "invalid json");
+        skipped++;
+        continue;
+      }
+      if (session.end <= session.start) {
+        error(file, reader.offset(), session.end == session.start
+            ? "empty interval" : "end before start");
+        skipped++;
+        continue;
+      }
+      if (session.start > tomorrow) {
+        warning(file, reader.offset(), "starts in the future");
+      }
+      if (session.end - session.start > 86400) {
+        warning(file, reader.offset(), "longer than a day");
+      }
+      if (session.project >= dict.size() || session.tag >= dict.size()) {
+        warning(file, reader.offset(), "label id missing in " + DICT_FILE);
+      }
+      if (session.start < prev_start && !runs_of_batches) {
+        if (monotonic) {
+          warning(file, reader.offset(), "not in chronological order");
+        }
+        monotonic = false;
+      }
+      prev_start = session.start;
+      records.push_back({session.start, session.end, reader.offset(),
+          static_cast<std::uint32_t>(line.size()), session.phase, session.project, session.tag,
+          file, tombstones().contains(session.start, line)});
+    }
+  }
+
+  auto by_start = [](const FsckRecord &a, const FsckRecord &b) { return a.start < b.start; };
+  if (!std::is_sorted(records.begin(), records.end(), by_start)) {
+    std::stable_sort(records.begin(), records.end(), by_start);
+  }
+  // sweep line: the record reaching furthest so far is the only one a later
+  // start can collide with first
+  const FsckRecord *furthest{nullptr};
+  for (const auto &record : records) {
+    if (record.dead) {
+      continue;
+    }
+    if (furthest && record.start < furthest->end) {
+      error(record.file, record.offset, "overlaps record at "
+          + (furthest->file == record.file ? "" : files[furthest->file] + " ")
+          + "offset " + std::to_string(furthest->offset));
+    }
+    if (!furthest || record.end > furthest->end) {
+      furthest = &record;
+    }
+  }
+
+  std::cout << records.size() + skipped << " records, " << errors << " errors, "
+    << warnings << " warnings" << std::endl;
+
+  if (repair && (errors || !monotonic)) {
+    // Sorted, without broken records, overlaps trimmed to the part not yet
+    // covered. Trimming keeps the union of the tracked time unchanged.
+    const std::string tmp_path{TRACK_FILE + ".fsck.tmp"};
+    std::vector<int> fds(files.size(), -1);
+    auto close_all = [&fds] {
+      for (int fd : fds) {
+        if (fd >= 0) {
+          ::close(fd);
+        }
+      }
+    };
+    std::uint64_t dropped{0};
+    try {
+      for (std::uint32_t file{0}; file < files.size(); ++file) {
+        if (repairable(file)) {
+          fds[file] = ::open(files[file].c_str(), O_RDONLY);
+        }
+      }
+      OutputBuffer out{tmp_path};
+      std::string buf;
+      std::int64_t covered{INT64_MIN};
+      auto reread = [&](const FsckRecord &record, char *dst) {
+        if (::pread(fds[record.file], dst, record.length, static_cast<off_t>(record.offset))
+            != static_cast<ssize_t>(record.length)) {
+          throw std::runtime_error("Could not reread " + files[record.file]);
+        }
+      };
+      auto copy = [&](const FsckRecord &record) {
+        char *dst{out.claim(record.length + 1)};
+        reread(record, dst);
+        dst[record.length] = '\n';
+        out.commit(record.length + 1);
+      };
+      for (const auto &record : records) {
+        if (!repairable(record.file)) {
+          // segments stay, what overlaps them from the other files yields
+          if (!record.dead) {
+            covered = std::max(covered, record.end);
+          }
+          continue;
+        }
+        // dead records stay as they are, their tombstones name the line
+        if (record.dead) {
+          copy(record);
+          continue;
+        }
+        if (record.end <= covered) {
+          dropped++;
+          continue;
+        }
+        if (record.start < covered) {
+          buf.resize(record.length);
+          reread(record, buf.data());
+          if (splice_start(buf, covered)) {
+            buf += '\n';
+          } else {
+            buf.clear();
+            encode_session(Session{covered, record.end, record.phase, record.project,
+                record.tag}, buf);
+          }
+          out.append(buf);
+        } else {
+          copy(record);
+        }
+        covered = record.end;
+      }
+      out.sync();
+    } catch (...) {
+      close_all();
+      ::unlink(tmp_path.c_str());
+      throw;
+    }
+    close_all();
+    if (std::rename(tmp_path.c_str(), TRACK_FILE.c_str()) != 0) {
+      throw std::runtime_error("Could not replace " + TRACK_FILE);
+    }
+    // its records are in the track file now
+    ::unlink(LATE_FILE.c_str());
+    std::cout << "Repaired " << TRACK_FILE << ": dropped " << skipped + dropped
+      << " records" << std::endl;
+  }
+  return errors + segment_errors;
+}
+
+// "YYYY-MM" of civil seconds
+std::string month_of(std::int64_t civil_seconds) {
+  std::int64_t y;
+  unsigned m, d;
+  civil_from_days(civil_day(civil_seconds), y, m, d);
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "%04lld-%02u", static_cast<long long>(y), m);
+  return buf;
+}
+
+// Writes the records of a month, sorted by start, as its segment and
+// returns what the manifest has to say about it
+Segment write_segment(const std::string &month, bool compressed,
+    const std::vector<std::pair<Session, std::string>> &records) {
+  Segment segment;
+  segment.month = month;
+  segment.compressed = compressed;
+  std::string content;
+  const std::int64_t first_day{civil_day(records.front().first.start)};
+  for (const auto &[record, text] : records) {
+    content += text;
+    content += '\n';
+    segment.min_start = std::min(segment.min_start, record.start);
+    segment.max_start = std::max(segment.max_start, record.start);
+    segment.max_end = std::max(segment.max_end, record.end);
+    if (record.phase == Phase::work) {
+      split_by_day(record.start, record.end, [&](std::int64_t day, std::int64_t secs) {
+        auto idx{static_cast<std::size_t>(day - first_day)};
+        if (idx >= segment.daily.size()) {
+          segment.daily.resize(idx+1);
+        }
+        segment.daily[idx] += secs;
+      });
+    }
+  }
+  if (compressed) {
+    content = deflate_segment(content);
+  }
+  segment.records = records.size();
+  segment.bytes = content.size();
+  segment.checksum = fnv1a(content);
+  replace_file(segment.path(), content);
+  return segment;
+}
+
+// Moves past months into a segment each and the rest of the late run into
+// the track file. Segments go first and the late run last, so a crash
+// duplicates records rather than losing them.
+void rotate_main(bool compress) {
+  std::int64_t y;
+  unsigned m, d;
+  civil_from_days(civil_day(to_civil_seconds(std::chrono::system_clock::now())), y, m, d);
+  const std::int64_t current_month{days_from_civil(y, m, 1)*86400};
+
+  // the lines themselves move, keys we do not decode survive
+  std::map<std::string, std::vector<std::pair<Session, std::string>>> moved;
+  std::vector<std::pair<std::int64_t, std::string>> late_kept;
+  std::string kept;
+  std::size_t count{0}, late{0};
+  std::string_view line;
+  Session session;
+  // calls fn with session and line set for every record of a file
+  auto read_lines = [&](const std::string &path, auto &&fn) {
+    LineReader reader{path};
+    while (reader.next(line)) {
+      if (trim(line).empty()) {
+        continue;
+      }
+      if (check_record_crc(line) == RecordCheck::corrupt
+          || !decode_session(line, session, FIELD_PHASE)) {
+        throw std::runtime_error("Broken record in " + path + " at offset "
+            + std::to_string(reader.offset()) + ", see fsck --repair");
+      }
+      fn();
+    }
+  };
+  read_lines(LATE_FILE, [&] {
+    late++;
+    if (session.start >= current_month) {
+      late_kept.emplace_back(session.start, std::string{line});
+    } else {
+      moved[month_of(session.start)].emplace_back(session, std::string{line});
+      count++;
+    }
+  });
+  // the late run is sorted per batch only, the track file is sorted as a
+  // whole, so the late records go in where they belong
+  std::stable_sort(late_kept.begin(), late_kept.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+  auto next_late{late_kept.begin()};
+  auto keep_late_before = [&](std::int64_t start) {
+    for (; next_late != late_kept.end() && next_late->first < start; ++next_late) {
+      kept += next_late->second;
+      kept += '\n';
+    }
+  };
+  read_lines(TRACK_FILE, [&] {
+    if (session.start >= current_month) {
+      keep_late_before(session.start);
+      kept.append(line);
+      kept += '\n';
+      return;
+    }
+    moved[month_of(session.start)].emplace_back(session, std::string{line});
+    count++;
+  });
+  keep_late_before(INT64_MAX);
+  auto segments{load_manifest()};
+  std::size_t converted{0};
+  if (compress) {
+    converted = static_cast<std::size_t>(std::count_if(segments.begin(), segments.end(),
+        [](const Segment &segment) { return !segment.compressed; }));
+  }
+  struct stat st;
+  bool has_late{::stat(LATE_FILE.c_str(), &st) == 0};
+  if (moved.empty() && !converted && !has_late) {
+    std::cout << "Nothing to rotate" << std::endl;
+    return;
+  }
+
+  // files the manifest no longer points to, removed once it is saved
+  std::vector<std::string> stale;
+  for (auto &[month, records] : moved) {
+    auto it{std::find_if(segments.begin(), segments.end(),
+        [&month = month](const Segment &segment) { return segment.month == month; })};
+    bool compressed{compress};
+    if (it != segments.end()) {
+      compressed = compressed || it->compressed;
+      stale.push_back(it->path());
+      LineReader old{it->path()};
+      while (old.next(line)) {
+        if (!trim(line).empty() && check_record_crc(line) != RecordCheck::corrupt
+            && decode_session(line, session, FIELD_PHASE)) {
+          records.emplace_back(session, std::string{line});
+        }
+      }
+      segments.erase(it);
+    }
+    std::stable_sort(records.begin(), records.end(), [](const auto &a, const auto &b) {
+      return a.first.start < b.first.start;
+    });
+    segments.push_back(write_segment(month, compressed, records));
+  }
+  for (auto &segment : segments) {
+    if (compress && !segment.compressed) {
+      std::string content{deflate_segment(read_all(segment.path()))};
+      stale.push_back(segment.path());
+      segment.compressed = true;
+      segment.bytes = content.size();
+      segment.checksum = fnv1a(content);
+      replace_file(segment.path(), content);
+    }
+  }
+  save_manifest(segments);
+  if (!moved.empty() || !late_kept.empty()) {
+    replace_file(TRACK_FILE, kept);
+  }
+  if (has_late) {
+    ::unlink(LATE_FILE.c_str());
+  }
+  for (const auto &path : stale) {
+    if (std::none_of(segments.begin(), segments.end(),
+          [&path](const Segment &segment) { return segment.path() == path; })) {
+      ::unlink(path.c_str());
+    }
+  }
+  std::cout << "Rotated " << count << " sessions into " << moved.size() << " segments";
+  if (late) {
+    std::cout << ", merged " << late << " late arrivals";
+  }
+  if (converted) {
+    std::cout << ", compressed " << converted << " segments";
+  }
+  std::cout << std::endl;
+}
+
+// Session ids are the starts as YYYYmmddTHHMMSS, unique as writers refuse
+// overlaps. START.HASH names one of several that fsck reports anyway.
+struct SessionId {
+  std::int64_t start;
+  std::optional<std::uint64_t> line_hash;
+};
+
+std::string session_id(std::int64_t start) {
+  std::string id;
+  for (char c : civil_to_iso(start)) {
+    if (c != '-' && c != ':') {
+      id += c;
+    }
+  }
+  return id;
+}
+
+std::string session_id(std::int64_t start, std::string_view line) {
+  std::ostringstream oss;
+  oss << session_id(start) << '.' << std::hex << fnv1a(line);
+  return oss.str();
+}
+
+// Also takes the start as written in the records or given to add
+bool parse_session_start(std::string_view str, std::int64_t &out) {
+  if (str.size() == 15 && str[8] == 'T') {
+    std::string iso{str.substr(0, 4)};
+    iso += '-';
+    iso += str.substr(4, 2);
+    iso += '-';
+    iso += str.substr(6, 5);
+    iso += ':';
+    iso += str.substr(11, 2);
+    iso += ':';
+    iso += str.substr(13, 2);
+    return parse_iso(iso, out);
+  }
+  return parse_user_datetime(str, out);
+}
+
+bool parse_session_id(std::string_view str, SessionId &out) {
+  out.line_hash.reset();
+  if (std::size_t dot{str.find('.')}; dot != std::string_view::npos) {
+    std::istringstream hex{std::string{str.substr(dot + 1)}};
+    std::uint64_t hash;
+    if (!(hex >> std::hex >> hash) || !hex.eof()) {
+      return false;
+    }
+    out.line_hash = hash;
+    str = str.substr(0, dot);
+  }
+  return parse_session_start(str, out.start);
+}
+
+// The live records with the id, with their lines
+std::vector<std::pair<Session, std::string>> find_records(const SessionId &id) {
+  std::vector<std::pair<Session, std::string>> found;
+  for_each_record_in_order(id.start, id.start + 1, FIELD_ALL,
+      [&](const Session &session, std::string_view line) {
+    if (session.start == id.start && (!id.line_hash || *id.line_hash == fnv1a(line))) {
+      found.emplace_back(session, std::string{line});
+    }
+  });
+  if (found.empty()) {
+    throw std::runtime_error("No session " + session_id(id.start));
+  }
+  return found;
+}
+
+// Deletes the sessions with the id by appending their tombstones, the files
+// holding them are only rewritten by compact
+void delete_main(const SessionId &id) {
+  auto found{find_records(id)};
+  std::vector<std::pair<std::int64_t, std::string>> dead;
+  for (auto &[session, line] : found) {
+    dead.emplace_back(session.start, std::move(line));
+  }
+  add_tombstones(dead);
+  std::cout << "Deleted " << session_id(id.start) << std::endl;
+}
+
+// Changes to a session, the fields not given stay as they are
+struct EditOptions {
+  std::optional<std::int64_t> start;
+  std::optional<std::int64_t> end;
+  std::optional<Phase> phase;
+  std::optional<std::uint32_t> project;
+  std::optional<std::uint32_t> tag;
+};
+
+// Appends the replacement like any other session, then the tombstone of
+// the old record. A crash in between leaves both rather than neither.
+void edit_main(const SessionId &id, const EditOptions &options) {
+  auto found{find_records(id)};
+  if (found.size() > 1) {
+    std::string ids;
+    for (const auto &[session, line] : found) {
+      ids += "\n  " + session_id(session.start, line);
+    }
+    throw std::runtime_error("Several sessions start at " + session_id(id.start)
+        + ", see fsck, or give one of:" + ids);
+  }
+  const auto &[old, old_line] = found.front();
+  Session session{old};
+  session.start = options.start.value_or(session.start);
+  session.end = options.end.value_or(session.end);
+  session.phase = options.phase.value_or(session.phase);
+  session.project = options.project.value_or(session.project);
+  session.tag = options.tag.value_or(session.tag);
+  if (session.end <= session.start) {
+    throw std::runtime_error("End is not after start");
+  }
+  if (session.start == old.start && session.end == old.end && session.phase == old.phase
+      && session.project == old.project && session.tag == old.tag) {
+    std::cout << "Nothing to change" << std::endl;
+    return;
+  }
+  // sessions starting before session.start may reach into it, the manifest
+  // knows which segments hold such sessions
+  bool overlaps{false};
+  for (const auto &path : track_files(session.start, session.end)) {
+    LineReader reader{path};
+    for_each_session_starting_in(reader, INT64_MIN, session.end,
+        [&](const Session &other, std::string_view line) {
+      overlaps = overlaps || (other.end > session.start
+        && !(other.start == old.start && line == old_line));
+    }, 0);
+  }
+  if (overlaps) {
+    throw std::runtime_error("Overlaps an already tracked session");
+  }
+  append_sessions({session});
+  add_tombstones({{old.start, old_line}});
+  std::cout << "Replaced " << session_id(id.start) << " by " << session_id(session.start)
+    << std::endl;
+}
+
+// Streams a file of the log into a copy without dead records, which then
+// replaces it. Returns the number dropped, the file is left alone if none.
+std::uint64_t drop_dead_records(const std::string &path) {
+  LineReader reader{path};
+  if (!reader.is_open()) {
+    return 0;
+  }
+  const std::string tmp_path{path + ".compact.tmp"};
+  std::uint64_t dropped{0};
+  try {
+    OutputBuffer out{tmp_path};
+    std::string_view line;
+    Session session;
+    while (reader.next(line)) {
+      if (decode_session(line, session, 0) && tombstones().contains(session.start, line)) {
+        dropped++;
+        continue;
+      }
+      out.append(line);
+      out.append("\n");
+    }
+    out.sync();
+  } catch (...) {
+    ::unlink(tmp_path.c_str());
+    throw;
+  }
+  if (!dropped) {
+    ::unlink(tmp_path.c_str());
+  } else if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    ::unlink(tmp_path.c_str());
+    throw std::runtime_error("Could not replace " + path);
+  }
+  return dropped;
+}
+
+// Rewrites the late run as a single sorted run without dead records. It is
+// read whole, like rotate does. Returns the number dropped.
+std::uint64_t merge_late_runs() {
+  LineReader reader{LATE_FILE};
+  if (!reader.is_open()) {
+    return 0;
+  }
+  std::vector<std::pair<std::int64_t, std::string>> records;
+  std::uint64_t dropped{0};
+  std::int64_t start{INT64_MIN};
+  std::string_view line;
+  Session session;
+  while (reader.next(line)) {
+    if (trim(line).empty()) {
+      continue;
+    }
+    // broken records keep following the one before them, readers skip them
+    if (decode_session(line, session, 0)) {
+      if (tombstones().contains(session.start, line)) {
+        dropped++;
+        continue;
+      }
+      start = session.start;
+    }
+    records.emplace_back(start, std::string{line});
+  }
+  std::stable_sort(records.begin(), records.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+  std::string content;
+  for (const auto &record : records) {
+    content += record.second;
+    content += '\n';
+  }
+  replace_file(LATE_FILE, content);
+  return dropped;
+}
+
+// Rewrites the files holding dead records and merges the late run before
+// dropping the tombstones, a crash leaves tombstones that name nothing
+void compact_main() {
+  const Tombstones &dead{tombstones()};
+  const std::size_t late_runs{late_ranges().size()};
+  if (dead.empty() && late_runs <= 1) {
+    std::cout << "Nothing to compact" << std::endl;
+    return;
+  }
+  std::uint64_t dropped{0};
+  std::vector<Segment> segments;
+  std::vector<std::string> stale;
+  std::string_view line;
+  Session session;
+  for (auto &segment : load_manifest()) {
+    if (!dead.any_in(segment.min_start, segment.max_start)) {
+      segments.push_back(std::move(segment));
+      continue;
+    }
+    std::vector<std::pair<Session, std::string>> records;
+    std::uint64_t dropped_here{0};
+    LineReader reader{segment.path()};
+    if (!reader.is_open()) {
+      throw std::runtime_error("Could not open " + segment.path());
+    }
+    while (reader.next(line)) {
+      if (trim(line).empty()) {
+        continue;
+      }
+      if (check_record_crc(line) == RecordCheck::corrupt
+          || !decode_session(line, session, FIELD_PHASE)) {
+        throw std::runtime_error("Broken record in " + segment.path() + " at offset "
+            + std::to_string(reader.offset()) + ", see fsck");
+      }
+      if (dead.contains(session.start, line)) {
+        dropped_here++;
+        continue;
+      }
+      records.emplace_back(session, std::string{line});
+    }
+    if (!dropped_here) {
+      segments.push_back(std::move(segment));
+      continue;
+    }
+    dropped += dropped_here;
+    stale.push_back(segment.path());
+    if (!records.empty()) {
+      segments.push_back(write_segment(segment.month, segment.compressed, records));
+    }
+  }
+  if (!stale.empty()) {
+    save_manifest(segments);
+  }
+  for (const auto &path : stale) {
+    if (std::none_of(segments.begin(), segments.end(),
+          [&path](const Segment &segment) { return segment.path() == path; })) {
+      ::unlink(path.c_str());
+    }
+  }
+  if (!dead.empty()) {
+    dropped += drop_dead_records(TRACK_FILE);
+  }
+  dropped += late_runs > 1 ? merge_late_runs() : drop_dead_records(LATE_FILE);
+  ::unlink(TOMBSTONE_FILE.c_str());
+  std::cout << "Dropped " << dropped << " dead records";
+  if (late_runs > 1) {
+    std::cout << ", merged " << late_runs << " runs of late arrivals";
+  }
+  std::cout << std::endl;
+}
+
+#include "bench.hpp"
+
+int main(int argc, char **argv) {
+  argparse::ArgumentParser program("mywarrior", "0.0.1");
+  program.add_argument("--io-uring")
+    .help("Read and write the files through io_uring where the kernel allows it")
+    .flag();
+  program.add_argument("--checksums")
+    .help("Give every record written a CRC32C, checked whenever it is read")
+    .flag();
+
+  argparse::ArgumentParser track_command("track");
+  track_command.add_description("Tracks pomodori");
+  track_command.add_argument("pomodori")
+    .help("The amount of pomodori (25min) done in a row")
+    .scan<'i', int>();
+  track_command.add_argument("--work")
+    .help("Length of a work phase in minutes")
+    .default_value(25)
+    .scan<'i', int>();
+  track_command.add_argument("--short-break")
+    .help("Length of a short break in minutes")
+    .default_value(5)
+    .scan<'i', int>();
+  track_command.add_argument("--long-break")
+    .help("Length of a long break in minutes")
+    .default_value(15)
+    .scan<'i', int>();
+  track_command.add_argument("--long-break-every")
+    .help("Take a long break after every n-th pomodoro, 0 to disable")
+    .default_value(4)
+    .scan<'i', int>();
+  track_command.add_argument("--project")
+    .help("Project the pomodori belong to");
+  track_command.add_argument("--tag")
+    .help("Tag for the pomodori");
+
+  argparse::ArgumentParser report_command("report");
+  report_command.add_description("provides report of recent work");
+  report_command.add_argument("--overlapping")
+    .help("List sessions overlapping START END (\"YYYY-mm-dd hh:mm\")")
+    .nargs(2);
+  report_command.add_argument("--heatmap")
+    .help("Show at which hours of which weekdays work happens")
+    .flag();
+  report_command.add_argument("--rolling")
+    .help("Moving total, average and best day over windows of N days (Nd, e.g. 7d or 30d)");
+  report_command.add_argument("--top")
+    .help("The N longest sessions, most productive days and longest streaks")
+    .scan<'i', int>();
+  report_command.add_argument("--daily")
+    .help("Work per day")
+    .flag();
+  report_command.add_argument("--weekly")
+    .help("Work per week")
+    .flag();
+  report_command.add_argument("--streaks")
+    .help("Longest and latest streak of days with work")
+    .flag();
+  report_command.add_argument("--stats")
+    .help("Statistics, percentiles and distribution of the session lengths")
+    .flag();
+  report_command.add_argument("--longest")
+    .help("Longest session")
+    .flag();
+  report_command.add_argument("--span")
+    .help("First and last activity")
+    .flag();
+  report_command.add_argument("--lengths")
+    .help("Distribution of the work session lengths")
+    .flag();
+  report_command.add_argument("--input")
+    .help("Read a columnar export or another track file for --lengths");
+  report_command.add_argument("--where")
+    .help("Only count sessions matching a filter, e.g. "
+        "\"weekday in (mon..fri) and hour >= 9 and duration > 20m and tag = clientX\"");
+  report_command.add_argument("--pipeline")
+    .help("Read, parse and aggregate in separate stages, print their counters to stderr")
+    .flag();
+  report_command.add_argument("--all")
+    .help("All of the above")
+    .flag();
+  report_command.add_argument("--from")
+    .help("Only total the work from this day on (YYYY-mm-dd)");
+  report_command.add_argument("--to")
+    .help("Only total the work up to this day (YYYY-mm-dd)");
+
+  argparse::ArgumentParser add_command("add");
+  add_command.add_description("Add manually tracked time");
+  add_command.add_argument("--start")
+    .help("Start as \"YYYY-mm-dd hh:mm\", skips the questions");
+  add_command.add_argument("--end")
+    .help("End as \"YYYY-mm-dd hh:mm\", skips the questions");
+  add_command.add_argument("--batch")
+    .help("Add all intervals of a csv (start,end[,phase]) or ndjson file, - for stdin");
+  add_command.add_argument("--project")
+    .help("Project the time belongs to");
+  add_command.add_argument("--tag")
+    .help("Tag for the time");
+
+  argparse::ArgumentParser import_command("import");
+  import_command.add_description("Import sessions from other trackers");
+  import_command.add_argument("--format")
+    .help("timew, csv or ics")
+    .required();
+  import_command.add_argument("file")
+    .help("File to import, - for stdin")
+    .nargs(argparse::nargs_pattern::optional)
+    .default_value(std::string{"-"});
+
+  argparse::ArgumentParser export_command("export");
+  export_command.add_description("Export tracked sessions");
+  export_command.add_argument("--format")
+    .help("csv, ics, ndjson or columnar")
+    .default_value(std::string{"ndjson"});
+  export_command.add_argument("--from")
+    .help("First day to export (YYYY-mm-dd)");
+  export_command.add_argument("--to")
+    .help("Last day to export (YYYY-mm-dd)");
+  export_command.add_argument("-o", "--output")
+    .help("Output file, - for stdout")
+    .default_value(std::string{"-"});
+
+  argparse::ArgumentParser rotate_command("rotate");
+  rotate_command.add_description(
+      "Move the sessions of past months out of the track file into monthly segments"
+      " and merge the late arrivals");
+  rotate_command.add_argument("--compress")
+    .help("Store the segments compressed, converting the existing ones")
+    .flag();
+
+  argparse::ArgumentParser edit_command("edit");
+  edit_command.add_description("Replace a session, the old record stays until compact");
+  edit_command.add_argument("id")
+    .help("Start of the session as YYYYmmddTHHMMSS, as in the ics UIDs, which names a"
+        " single session: add, import and edit refuse overlaps. Where fsck finds several,"
+        " edit lists them as YYYYmmddTHHMMSS.HASH");
+  edit_command.add_argument("--start")
+    .help("New start as \"YYYY-mm-dd hh:mm\"");
+  edit_command.add_argument("--end")
+    .help("New end as \"YYYY-mm-dd hh:mm\"");
+  edit_command.add_argument("--phase")
+    .help("work, short_break or long_break");
+  edit_command.add_argument("--project")
+    .help("Project the time belongs to, empty for none");
+  edit_command.add_argument("--tag")
+    .help("Tag for the time, empty for none");
+
+  argparse::ArgumentParser delete_command("delete");
+  delete_command.add_description("Delete a session, the record stays until compact");
+  delete_command.add_argument("id")
+    .help("Start of the session as YYYYmmddTHHMMSS, as in the ics UIDs, which names a"
+        " single session: add, import and edit refuse overlaps. Where fsck finds several,"
+        " edit lists them as YYYYmmddTHHMMSS.HASH");
+
+  argparse::ArgumentParser compact_command("compact");
+  compact_command.add_description(
+      "Rewrite the files holding deleted or replaced records and merge the late arrivals");
+
+  argparse::ArgumentParser fsck_command("fsck");
+  fsck_command.add_description(
+      "Check the files of the log for broken records and overlaps, and the segments");
+  fsck_command.add_argument("--repair")
+    .help("Write a sorted copy without broken records and overlaps")
+    .flag();
+
+  argparse::ArgumentParser bench_command("bench");
+  bench_command.add_description("Micro benchmarks for development");
+  bench_command.add_argument("name")
+    .help("interval-tree, aggregators, session-table, projection, structural, io, crc, csv"
+        " or late");
+  bench_command.add_argument("--count")
+    .help("Number of generated sessions")
+    .default_value(1000000)
+    .scan<'i', int>();
+
+  program.add_subparser(track_command);
+  program.add_subparser(report_command);
+  program.add_subparser(add_command);
+  program.add_subparser(import_command);
+  program.add_subparser(export_command);
+  program.add_subparser(rotate_command);
+  program.add_subparser(edit_command);
+  program.add_subparser(delete_command);
+  program.add_subparser(compact_command);
+  program.add_subparser(fsck_command);
+  program.add_subparser(bench_command);
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::exception &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    return EXIT_FAILURE;
+  }
+  use_io_uring = program.get<bool>("--io-uring");
+  write_checksums = program.get<bool>("--checksums");
+
+  if (program.is_subcommand_used("track")) {
+    debug_print("Starting Track");
+    int pomodori{track_command.get<int>("pomodori")};
+    int work{track_command.get<int>("--work")},
+      short_break{track_command.get<int>("--short-break")},
+      long_break{track_command.get<int>("--long-break")},
+      long_break_every{track_command.get<int>("--long-break-every")};
+    if (pomodori < 1 || work < 1 || short_break < 0 || long_break < 0
+        || long_break_every < 0) {
+      std::cerr << "pomodori and phase lengths have to be positive" << std::endl;
+      return EXIT_FAILURE;
+    }
+    CycleConfig config{static_cast<std::uint64_t>(work)*60,
+      static_cast<std::uint64_t>(short_break)*60,
+      static_cast<std::uint64_t>(long_break)*60,
+      static_cast<std::uint64_t>(long_break_every)};
+    try {
+      auto dict{Dictionary::load()};
+      std::uint32_t project{0}, tag{0};
+      if (auto name = track_command.present("--project")) {
+        project = dict.intern(*name);
+      }
+      if (auto name = track_command.present("--tag")) {
+        tag = dict.intern(*name);
+      }
+      track_main(pomodori, config, project, tag);
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  } else if (program.is_subcommand_used("report")) {
+    debug_print("Starting Report");
+    try {
+      if (report_command.is_used("--overlapping")) {
+        auto range{report_command.get<std::vector<std::string>>("--overlapping")};
+        std::int64_t start, end;
+        if (!parse_user_datetime(range[0], start) || !parse_user_datetime(range[1], end)) {
+          std::cerr << "Expected \"YYYY-mm-dd hh:mm\"" << std::endl;
+          return EXIT_FAILURE;
+        }
+        report_overlapping(start, end);
+        return EXIT_SUCCESS;
+      }
+      std::int64_t from{INT64_MIN}, to{INT64_MAX};
+      if (!parse_day_option(report_command.present("--from"), from, 0)
+          || !parse_day_option(report_command.present("--to"), to, 0)) {
+        std::cerr << "Expected YYYY-mm-dd" << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (!report_command.is_used("--to")) {
+        to = to_civil_seconds(std::chrono::system_clock::now());
+      }
+      std::int64_t first_day{from == INT64_MIN ? INT64_MIN/86400 : civil_day(from)},
+        last_day{civil_day(to)};
+      if (report_command.get<bool>("--lengths")) {
+        auto input{report_command.present("--input")};
+        report_lengths(input ? SessionTable::load(*input) : SessionTable::load(),
+            from, report_command.is_used("--to") ? to + 86400 : INT64_MAX);
+        return EXIT_SUCCESS;
+      }
+      if (report_command.get<bool>("--heatmap")) {
+        report_heatmap(first_day, last_day);
+        return EXIT_SUCCESS;
+      }
+      if (auto rolling = report_command.present("--rolling")) {
+        char *end;
+        long window{std::strtol(rolling->c_str(), &end, 10)};
+        if (window <= 0 || std::string_view{end} != "d") {
+          std::cerr << "Expected a window of days like 7d" << std::endl;
+          return EXIT_FAILURE;
+        }
+        report_rolling(window, first_day, last_day);
+        return EXIT_SUCCESS;
+      }
+      if (auto top = report_command.present<int>("--top")) {
+        if (*top <= 0) {
+          std::cerr << "--top needs a positive count" << std::endl;
+          return EXIT_FAILURE;
+        }
+        report_top(static_cast<std::size_t>(*top), from,
+            report_command.is_used("--to") ? to + 86400 : INT64_MAX, first_day, last_day);
+        return EXIT_SUCCESS;
+      }
+      ReportOptions options;
+      bool all{report_command.get<bool>("--all")};
+      options.daily = all || report_command.get<bool>("--daily");
+      options.weekly = all || report_command.get<bool>("--weekly");
+      options.streaks = all || report_command.get<bool>("--streaks");
+      options.stats = all || report_command.get<bool>("--stats");
+      options.longest = all || report_command.get<bool>("--longest");
+      options.span = all || report_command.get<bool>("--span");
+      options.pipeline = report_command.get<bool>("--pipeline");
+      if (auto where = report_command.present("--where")) {
+        options.where = FilterProgram::compile(*where, Dictionary::load());
+      }
+      if ((report_command.is_used("--from") || report_command.is_used("--to"))
+          && !options.any_statistic() && !options.where) {
+        report_range(first_day, last_day);
+        return EXIT_SUCCESS;
+      }
+      if (report_command.is_used("--from")) {
+        options.from = from;
+      }
+      if (report_command.is_used("--to")) {
+        options.to = to + 86400;
+      }
+      report_main(options);
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  } else if (program.is_subcommand_used("add")) {
+    debug_print("Starting Add");
+    try {
+      auto dict{Dictionary::load()};
+      std::uint32_t project{0}, tag{0};
+      if (auto name = add_command.present("--project")) {
+        project = dict.intern(*name);
+      }
+      if (auto name = add_command.present("--tag")) {
+        tag = dict.intern(*name);
+      }
+      if (auto batch = add_command.present("--batch")) {
+        return add_batch(read_all(*batch), project, tag) ? EXIT_FAILURE : EXIT_SUCCESS;
+      }
+      auto start{add_command.present("--start")},
+        end{add_command.present("--end")};
+      if (start || end) {
+        if (!(start && end)) {
+          std::cerr << "--start and --end have to be given together" << std::endl;
+          return EXIT_FAILURE;
+        }
+        std::int64_t start_civil, end_civil;
+        if (!parse_user_datetime(*start, start_civil)
+            || !parse_user_datetime(*end, end_civil)) {
+          std::cerr << "Expected \"YYYY-mm-dd hh:mm\"" << std::endl;
+          return EXIT_FAILURE;
+        }
+        return add_batch(civil_to_iso(start_civil) + ","
+            + civil_to_iso(end_civil), project, tag) ? EXIT_FAILURE : EXIT_SUCCESS;
+      }
+      return add_main(project, tag) ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (program.is_subcommand_used("import")) {
+    debug_print("Starting Import");
+    auto format_name{import_command.get<std::string>("--format")};
+    ImportFormat format;
+    if (format_name == "timew") {
+      format = ImportFormat::timew;
+    } else if (format_name == "csv") {
+      format = ImportFormat::csv;
+    } else if (format_name == "ics") {
+      format = ImportFormat::ics;
+    } else {
+      std::cerr << "Unknown format " << format_name << std::endl;
+      return EXIT_FAILURE;
+    }
+    try {
+      import_main(format, import_command.get<std::string>("file"));
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (program.is_subcommand_used("export")) {
+    debug_print("Starting Export");
+    auto format_name{export_command.get<std::string>("--format")};
+    ExportFormat format;
+    if (format_name == "csv") {
+      format = ExportFormat::csv;
+    } else if (format_name == "ics") {
+      format = ExportFormat::ics;
+    } else if (format_name == "ndjson") {
+      format = ExportFormat::ndjson;
+    } else if (format_name == "columnar") {
+      format = ExportFormat::columnar;
+    } else {
+      std::cerr << "Unknown format " << format_name << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::int64_t from{INT64_MIN}, to{INT64_MAX};
+    if (!parse_day_option(export_command.present("--from"), from, 0)
+        || !parse_day_option(export_command.present("--to"), to, 86400)) {
+      std::cerr << "Expected YYYY-mm-dd" << std::endl;
+      return EXIT_FAILURE;
+    }
+    try {
+      export_main(format, export_command.get<std::string>("--output"), from, to);
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (program.is_subcommand_used("rotate")) {
+    debug_print("Starting Rotate");
+    try {
+      rotate_main(rotate_command.get<bool>("--compress"));
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (program.is_subcommand_used("edit") || program.is_subcommand_used("delete")) {
+    bool edit{program.is_subcommand_used("edit")};
+    auto &command{edit ? edit_command : delete_command};
+    SessionId id;
+    if (!parse_session_id(command.get<std::string>("id"), id)) {
+      std::cerr << "Expected a session id as YYYYmmddTHHMMSS[.HASH]" << std::endl;
+      return EXIT_FAILURE;
+    }
+    try {
+      if (!edit) {
+        debug_print("Starting Delete");
+        delete_main(id);
+        return EXIT_SUCCESS;
+      }
+      debug_print("Starting Edit");
+      EditOptions options;
+      for (auto [name, field] : {std::pair{"--start", &options.start},
+          std::pair{"--end", &options.end}}) {
+        if (auto value = edit_command.present(name)) {
+          std::int64_t civil;
+          if (!parse_user_datetime(*value, civil)) {
+            std::cerr << "Expected \"YYYY-mm-dd hh:mm\"" << std::endl;
+            return EXIT_FAILURE;
+          }
+          *field = civil;
+        }
+      }
+      if (auto name = edit_command.present("--phase")) {
+        Phase phase;
+        if (!parse_phase(*name, phase)) {
+          std::cerr << "Unknown phase " << *name << std::endl;
+          return EXIT_FAILURE;
+        }
+        options.phase = phase;
+      }
+      auto dict{Dictionary::load()};
+      if (auto name = edit_command.present("--project")) {
+        options.project = name->empty() ? 0 : dict.intern(*name);
+      }
+      if (auto name = edit_command.present("--tag")) {
+        options.tag = name->empty() ? 0 : dict.intern(*name);
+      }
+      edit_main(id, options);
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (program.is_subcommand_used("compact")) {
+    debug_print("Starting Compact");
+    try {
+      compact_main();
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (program.is_subcommand_used("fsck")) {
+    debug_print("Starting Fsck");
+    try {
+      std::uint64_t errors{fsck_main(fsck_command.get<bool>("--repair"))};
+      return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (const std::exception &err) {
+      std::cerr << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (program.is_subcommand_used("bench")) {
+    auto name{bench_command.get<std::string>("name")};
+    auto count{static_cast<std::size_t>(std::max(1, bench_command.get<int>("--count")))};
+    if (name == "interval-tree") {
+      bench_interval_tree(count);
+    } else if (name == "aggregators") {
+      bench_aggregators(count);
+    } else if (name == "session-table") {
+      bench_session_table(count);
+    } else if (name == "projection") {
+      bench_projection(count);
+    } else if (name == "structural") {
+      bench_structural(count);
+    } else if (name == "io") {
+      bench_io(count);
+    } else if (name == "crc") {
+      bench_crc(count);
+    } else if (name == "csv") {
+      bench_csv(count);
+    } else if (name == "late") {
+      bench_late(count);
+    } else {
+      std::cerr << "Unknown benchmark " << name << std::endl;
+      return EXIT_FAILURE;
+    }
   } else {
     std::cerr << program << std::endl;
     return EXIT_FAILURE;
@@ -0,0 +1,453 @@
+// SIMD kernels, part of the single translation unit of main.cc. Each one
+// has a scalar fallback and picks the AVX2 variant at runtime.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MYWARRIOR_X86 1
+#endif
+
+bool cpu_has_avx2() {
+#ifdef MYWARRIOR_X86
+  static const bool has_avx2{__builtin_cpu_supports("avx2") != 0};
+  return has_avx2;
+#else
+  return false;
+#endif
+}
+
+// One bit per byte of a 64 byte block
+struct CharMasks {
+  std::uint64_t quote{0};
+  std::uint64_t colon{0};
+  std::uint64_t newline{0};
+  std::uint64_t backslash{0};
+};
+
+CharMasks char_masks_scalar(const char *block) {
+  CharMasks masks;
+  for (unsigned i{0}; i < 64; ++i) {
+    std::uint64_t bit{std::uint64_t{1} << i};
+    switch (block[i]) {
+      case '"': masks.quote |= bit; break;
+      case ':': masks.colon |= bit; break;
+      case '\n': masks.newline |= bit; break;
+      case '\\': masks.backslash |= bit; break;
+      default: break;
+    }
+  }
+  return masks;
+}
+
+#ifdef MYWARRIOR_X86
+__attribute__((target("avx2")))
+inline std::uint64_t eq_mask_avx2(__m256i lo, __m256i hi, char c) {
+  const __m256i needle{_mm256_set1_epi8(c)};
+  return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle)))
+    | static_cast<std::uint64_t>(static_cast<std::uint32_t>(
+          _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)))) << 32;
+}
+
+__attribute__((target("avx2")))
+CharMasks char_masks_avx2(const char *block) {
+  const __m256i lo{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(block))};
+  const __m256i hi{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32))};
+  return CharMasks{eq_mask_avx2(lo, hi, '"'), eq_mask_avx2(lo, hi, ':'),
+    eq_mask_avx2(lo, hi, '\n'), eq_mask_avx2(lo, hi, '\\')};
+}
+
+// SSE2 is part of x86-64, so this is the fallback there
+inline std::uint64_t eq_mask_sse2(const __m128i *parts, char c) {
+  const __m128i needle{_mm_set1_epi8(c)};
+  std::uint64_t mask{0};
+  for (unsigned i{0}; i < 4; ++i) {
+    mask |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(parts[i], needle)))) << (16*i);
+  }
+  return mask;
+}
+
+CharMasks char_masks_sse2(const char *block) {
+  __m128i parts[4];
+  for (unsigned i{0}; i < 4; ++i) {
+    parts[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16*i));
+  }
+  return CharMasks{eq_mask_sse2(parts, '"'), eq_mask_sse2(parts, ':'),
+    eq_mask_sse2(parts, '\n'), eq_mask_sse2(parts, '\\')};
+}
+#endif
+
+// Bits of the characters escaped by an odd run of backslashes before them.
+// prev_escaped carries a run that ends in the previous block.
+std::uint64_t escaped_chars(std::uint64_t backslash, std::uint64_t &prev_escaped) {
+  const std::uint64_t even_bits{0x5555555555555555ULL};
+  backslash &= ~prev_escaped;
+  std::uint64_t follows_escape{backslash << 1 | prev_escaped};
+  std::uint64_t odd_starts{backslash & ~even_bits & ~follows_escape};
+  std::uint64_t even_sequences;
+  prev_escaped = __builtin_add_overflow(odd_starts, backslash, &even_sequences);
+  return (even_bits ^ (even_sequences << 1)) & follows_escape;
+}
+
+// Bit i is the xor of the bits up to and including i
+std::uint64_t prefix_xor(std::uint64_t bits) {
+  for (unsigned shift{1}; shift < 64; shift *= 2) {
+    bits ^= bits << shift;
+  }
+  return bits;
+}
+
+// Positions found by structural_index. Grows without initializing, as
+// most of what is claimed up front is never written.
+class StructuralIndex {
+ public:
+  std::size_t size() const { return size_; }
+  std::uint32_t *data() { return data_.get(); }
+  const std::uint32_t *data() const { return data_.get(); }
+  std::uint32_t &operator[](std::size_t i) { return data_[i]; }
+  std::uint32_t operator[](std::size_t i) const { return data_[i]; }
+  void clear() { size_ = 0; }
+
+  bool operator==(const StructuralIndex &other) const {
+    return std::equal(data(), data() + size_, other.data(), other.data() + other.size_);
+  }
+
+  // Room for n more positions at the end, see commit()
+  std::uint32_t *claim(std::size_t n) {
+    if (size_ + n > capacity_) {
+      capacity_ = std::max(size_ + n, capacity_*2);
+      std::unique_ptr<std::uint32_t[]> grown{new std::uint32_t[capacity_]};
+      std::copy(data(), data() + size_, grown.get());
+      data_ = std::move(grown);
+    }
+    return data_.get() + size_;
+  }
+
+  void commit(std::size_t n) { size_ += n; }
+
+ private:
+  std::unique_ptr<std::uint32_t[]> data_;
+  std::size_t size_{0}, capacity_{0};
+};
+
+// Appends the positions of newlines, unescaped quotes and colons outside of
+// strings to out, 64 bytes at a time as in simdjson's first stage. data has
+// to start at a line boundary.
+template <CharMasks (*char_masks)(const char *)>
+inline void structural_index_with(const char *data, std::size_t len, StructuralIndex &out) {
+  std::uint64_t prev_escaped{0}, in_string{0};
+  // at most one position per byte
+  std::uint32_t *begin{out.claim(len)}, *pos{begin};
+  char tail[64];
+  for (std::size_t base{0}; base < len; base += 64) {
+    const char *block{data + base};
+    if (len - base < 64) {
+      std::memset(tail, ' ', sizeof(tail));
+      std::memcpy(tail, block, len - base);
+      block = tail;
+    }
+    CharMasks masks{char_masks(block)};
+    if (masks.backslash | prev_escaped) {
+      masks.quote &= ~escaped_chars(masks.backslash, prev_escaped);
+    }
+    std::uint64_t strings{prefix_xor(masks.quote) ^ in_string};
+    in_string = static_cast<std::uint64_t>(static_cast<std::int64_t>(strings) >> 63);
+    for (std::uint64_t bits{masks.quote | masks.newline | (masks.colon & ~strings)}; bits;
+        bits &= bits - 1) {
+      *pos++ = static_cast<std::uint32_t>(base) + static_cast<std::uint32_t>(__builtin_ctzll(bits));
+    }
+  }
+  out.commit(static_cast<std::size_t>(pos - begin));
+}
+
+void structural_index_scalar(const char *data, std::size_t len, StructuralIndex &out) {
+  structural_index_with<char_masks_scalar>(data, len, out);
+}
+
+#ifdef MYWARRIOR_X86
+void structural_index_sse2(const char *data, std::size_t len, StructuralIndex &out) {
+  structural_index_with<char_masks_sse2>(data, len, out);
+}
+
+__attribute__((target("avx2")))
+void structural_index_avx2(const char *data, std::size_t len, StructuralIndex &out) {
+  structural_index_with<char_masks_avx2>(data, len, out);
+}
+#endif
+
+void structural_index(const char *data, std::size_t len, StructuralIndex &out) {
+#ifdef MYWARRIOR_X86
+  if (cpu_has_avx2()) {
+    structural_index_avx2(data, len, out);
+  } else {
+    structural_index_sse2(data, len, out);
+  }
+#else
+  structural_index_scalar(data, len, out);
+#endif
+}
+
+// Bit kernels
+#ifdef MYWARRIOR_X86
+// Nibble lookup popcount (Mula et al.), sums with psadbw
+__attribute__((target("avx2")))
+std::uint64_t popcount_words_avx2(const std::uint64_t *words, std::size_t n) {
+  const __m256i lookup{_mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4)};
+  const __m256i low_mask{_mm256_set1_epi8(0x0f)};
+  __m256i acc{_mm256_setzero_si256()};
+  std::size_t i{0};
+  for (; i+4 <= n; i += 4) {
+    __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + i))};
+    __m256i lo{_mm256_and_si256(v, low_mask)};
+    __m256i hi{_mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask)};
+    __m256i bytes{_mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+        _mm256_shuffle_epi8(lookup, hi))};
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+  }
+  std::uint64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+  std::uint64_t total{lanes[0] + lanes[1] + lanes[2] + lanes[3]};
+  for (; i < n; ++i) {
+    total += static_cast<std::uint64_t>(__builtin_popcountll(words[i]));
+  }
+  return total;
+}
+
+__attribute__((target("avx2")))
+void or_words_avx2(std::uint64_t *dst, const std::uint64_t *src, std::size_t n) {
+  std::size_t i{0};
+  for (; i+4 <= n; i += 4) {
+    auto *d{reinterpret_cast<__m256i *>(dst + i)};
+    _mm256_storeu_si256(d, _mm256_or_si256(_mm256_loadu_si256(d),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i))));
+  }
+  for (; i < n; ++i) {
+    dst[i] |= src[i];
+  }
+}
+
+__attribute__((target("avx2")))
+void and_words_avx2(std::uint64_t *dst, const std::uint64_t *src, std::size_t n) {
+  std::size_t i{0};
+  for (; i+4 <= n; i += 4) {
+    auto *d{reinterpret_cast<__m256i *>(dst + i)};
+    _mm256_storeu_si256(d, _mm256_and_si256(_mm256_loadu_si256(d),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i))));
+  }
+  for (; i < n; ++i) {
+    dst[i] &= src[i];
+  }
+}
+#endif
+
+std::uint64_t popcount_words(const std::uint64_t *words, std::size_t n) {
+#ifdef MYWARRIOR_X86
+  if (cpu_has_avx2()) {
+    return popcount_words_avx2(words, n);
+  }
+#endif
+  std::uint64_t total{0};
+  for (std::size_t i{0}; i < n; ++i) {
+    total += static_cast<std::uint64_t>(__builtin_popcountll(words[i]));
+  }
+  return total;
+}
+
+void or_words(std::uint64_t *dst, const std::uint64_t *src, std::size_t n) {
+#ifdef MYWARRIOR_X86
+  if (cpu_has_avx2()) {
+    return or_words_avx2(dst, src, n);
+  }
+#endif
+  for (std::size_t i{0}; i < n; ++i) {
+    dst[i] |= src[i];
+  }
+}
+
+void and_words(std::uint64_t *dst, const std::uint64_t *src, std::size_t n) {
+#ifdef MYWARRIOR_X86
+  if (cpu_has_avx2()) {
+    return and_words_avx2(dst, src, n);
+  }
+#endif
+  for (std::size_t i{0}; i < n; ++i) {
+    dst[i] &= src[i];
+  }
+}
+
+// Column kernels
+#ifdef MYWARRIOR_X86
+__attribute__((target("avx2")))
+std::int64_t sum_int32_avx2(const std::int32_t *values, std::size_t n) {
+  __m256i acc_lo{_mm256_setzero_si256()}, acc_hi{_mm256_setzero_si256()};
+  std::size_t i{0};
+  for (; i+8 <= n; i += 8) {
+    __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i))};
+    acc_lo = _mm256_add_epi64(acc_lo, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    acc_hi = _mm256_add_epi64(acc_hi, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+  std::int64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi64(acc_lo, acc_hi));
+  std::int64_t total{lanes[0] + lanes[1] + lanes[2] + lanes[3]};
+  for (; i < n; ++i) {
+    total += values[i];
+  }
+  return total;
+}
+
+__attribute__((target("avx2")))
+void minmax_int32_avx2(const std::int32_t *values, std::size_t n,
+    std::int32_t &min, std::int32_t &max) {
+  __m256i vmin{_mm256_set1_epi32(INT32_MAX)}, vmax{_mm256_set1_epi32(INT32_MIN)};
+  std::size_t i{0};
+  for (; i+8 <= n; i += 8) {
+    __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i))};
+    vmin = _mm256_min_epi32(vmin, v);
+    vmax = _mm256_max_epi32(vmax, v);
+  }
+  std::int32_t mins[8], maxs[8];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(mins), vmin);
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxs), vmax);
+  min = *std::min_element(mins, mins+8);
+  max = *std::max_element(maxs, maxs+8);
+  for (; i < n; ++i) {
+    min = std::min(min, values[i]);
+    max = std::max(max, values[i]);
+  }
+}
+
+__attribute__((target("avx2")))
+void filter_range_avx2(const std::int64_t *values, std::size_t n, std::int64_t lo,
+    std::int64_t hi, std::vector<std::uint32_t> &out) {
+  // lo <= v < hi  <=>  v > lo-1 && hi > v, lo is never INT64_MIN here
+  const __m256i vlo{_mm256_set1_epi64x(lo-1)}, vhi{_mm256_set1_epi64x(hi)};
+  std::size_t i{0};
+  for (; i+4 <= n; i += 4) {
+    __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i))};
+    __m256i in{_mm256_and_si256(_mm256_cmpgt_epi64(v, vlo), _mm256_cmpgt_epi64(vhi, v))};
+    auto mask{static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(in)))};
+    while (mask) {
+      out.push_back(static_cast<std::uint32_t>(i + static_cast<std::size_t>(__builtin_ctz(mask))));
+      mask &= mask-1;
+    }
+  }
+  for (; i < n; ++i) {
+    if (values[i] >= lo && values[i] < hi) {
+      out.push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+void histogram_int32_avx2(const std::int32_t *values, std::size_t n,
+    std::int32_t width, std::uint64_t *counts, std::size_t buckets) {
+  // (v + 0.5) / width is at least 0.5/width away from an integer, and in
+  // double the rounding error stays far below that for every int32 v
+  const __m256d inv{_mm256_set1_pd(1.0 / width)};
+  const __m256d half{_mm256_set1_pd(0.5)};
+  const __m256i last{_mm256_set1_epi32(static_cast<int>(buckets-1))};
+  // one set of counters per lane, so runs of equal buckets do not
+  // serialize on the same memory location
+  std::vector<std::uint32_t> lane_counts(8*buckets);
+  std::uint32_t *lanes{lane_counts.data()};
+  const __m256i lane_base{_mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+      _mm256_set1_epi32(static_cast<int>(buckets)))};
+  alignas(32) std::int32_t idx[8];
+  std::size_t i{0};
+  for (; i+8 <= n; i += 8) {
+    __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i))};
+    v = _mm256_max_epi32(v, _mm256_setzero_si256());
+    __m256d lo{_mm256_cvtepi32_pd(_mm256_castsi256_si128(v))},
+      hi{_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1))};
+    __m256i q{_mm256_set_m128i(
+        _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_add_pd(hi, half), inv)),
+        _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_add_pd(lo, half), inv)))};
+    __m256i b{_mm256_add_epi32(_mm256_min_epi32(q, last), lane_base)};
+    _mm256_store_si256(reinterpret_cast<__m256i *>(idx), b);
+    lanes[idx[0]]++; lanes[idx[1]]++; lanes[idx[2]]++; lanes[idx[3]]++;
+    lanes[idx[4]]++; lanes[idx[5]]++; lanes[idx[6]]++; lanes[idx[7]]++;
+    // flush before the 32 bit lane counters could overflow
+    if ((i & ((std::size_t{1} << 31) - 8)) == 0 && i) {
+      for (std::size_t j{0}; j < 8*buckets; ++j) {
+        counts[j % buckets] += lanes[j];
+        lanes[j] = 0;
+      }
+    }
+  }
+  for (std::size_t j{0}; j < 8*buckets; ++j) {
+    counts[j % buckets] += lanes[j];
+  }
+  for (; i < n; ++i) {
+    counts[std::min<std::size_t>(static_cast<std::size_t>(std::max(values[i], 0)/width),
+        buckets-1)]++;
+  }
+}
+#endif
+
+std::int64_t sum_int32(const std::int32_t *values, std::size_t n) {
+#ifdef MYWARRIOR_X86
+  if (cpu_has_avx2()) {
+    return sum_int32_avx2(values, n);
+  }
+#endif
+  std::int64_t total{0};
+  for (std::size_t i{0}; i < n; ++i) {
+    total += values[i];
+  }
+  return total;
+}
+
+// Leaves min and max untouched for n == 0
+void minmax_int32(const std::int32_t *values, std::size_t n,
+    std::int32_t &min, std::int32_t &max) {
+  if (!n) {
+    return;
+  }
+#ifdef MYWARRIOR_X86
+  if (cpu_has_avx2()) {
+    return minmax_int32_avx2(values, n, min, max);
+  }
+#endif
+  min = INT32_MAX;
+  max = INT32_MIN;
+  for (std::size_t i{0}; i < n; ++i) {
+    min = std::min(min, values[i]);
+    max = std::max(max, values[i]);
+  }
+}
+
+// Appends the indices of all values in [lo, hi) to out
+void filter_range(const std::int64_t *values, std::size_t n, std::int64_t lo,
+    std::int64_t hi, std::vector<std::uint32_t> &out) {
+#ifdef MYWARRIOR_X86
+  if (cpu_has_avx2() && lo != INT64_MIN) {
+    return filter_range_avx2(values, n, lo, hi, out);
+  }
+#endif
+  for (std::size_t i{0}; i < n; ++i) {
+    if (values[i] >= lo && values[i] < hi) {
+      out.push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+}
+
+// counts[v / width] += 1, the last bucket takes everything beyond
+void histogram_int32(const std::int32_t *values, std::size_t n,
+    std::int32_t width, std::uint64_t *counts, std::size_t buckets) {
+#ifdef MYWARRIOR_X86
+  if (cpu_has_avx2()) {
+    return histogram_int32_avx2(values, n, width, counts, buckets);
+  }
+#endif
+  for (std::size_t i{0}; i < n; ++i) {
+    counts[std::min<std::size_t>(static_cast<std::size_t>(std::max(values[i], 0)/width),
+        buckets-1)]++;
+  }
+}